@@ -38,15 +38,24 @@ public class Main extends AppCompatActivity implements CvCameraViewListener2, RP
 
     /* Settings */
     private static final RPPG.RPPGAlgorithm ALGORITHM = RPPG.RPPGAlgorithm.g;
+    private static final RPPG.RPPGDetector DETECTOR = RPPG.RPPGDetector.haar;
+    private static final int MAX_FACES = 1;
     private static final double SAMPLING_FREQUENCY = 1;
-    private static final double RESCAN_FREQUENCY = 1;
+    private static final double RESCAN_FREQUENCY = 0.2;
+    private static final double FRAME_BUDGET = 0;
+    private static final int ESTIMATION_HOP_SAMPLES = 0;
+    private static final int ESTIMATION_HOP_MILLIS = 250;
     private static final double TIME_BASE = 0.001;
-    private static final int MIN_SIGNAL_SIZE = 2;
+    private static final int DOWNSAMPLE = 1;
+    private static final double PROGRESSIVE_SIGNAL_SIZE = 4.5;
+    private static final int MIN_SIGNAL_SIZE = 6;
     private static final int MAX_SIGNAL_SIZE = 6;
     private static final boolean LOG = false;
     private static final boolean VIDEO = false;
     private static final boolean GUI = true;
     private static final int VIDEO_BITRATE = 100000;
+    private static final String BENCHMARK_FRAMES = null;                        // Replay these frames below the files directory first, e.g. "frames/%04d.png"
+    private static final double BENCHMARK_FPS = 30;
 
     /* Constants */
     private static final String TAG = "Heartbeat::Main";
@@ -56,6 +65,7 @@ public class Main extends AppCompatActivity implements CvCameraViewListener2, RP
 
     private CameraBridgeViewBase mOpenCvCameraView;
     private RPPG rPPG;
+    private boolean rPPGLoaded;
     private RPPGResultQueue queue;
     private Mat mRgba;
     private Mat mGray;
@@ -91,6 +101,21 @@ public class Main extends AppCompatActivity implements CvCameraViewListener2, RP
         }
     };
 
+    /**
+     * Copy the cascade of the configured detector backend to the cascade directory
+     * @param cascadeDir - the directory
+     * @return the path of the copy
+     */
+    private String loadDetectorFile(File cascadeDir) throws IOException {
+        switch (DETECTOR) {
+            case lbp:
+                return loadCascadeFile(cascadeDir, R.raw.lbpcascade_frontalface, "lbpcascade_frontalface.xml");
+            case haar:
+            default:
+                return loadCascadeFile(cascadeDir, R.raw.haarcascade_frontalface_alt, "haarcascade_frontalface_alt.xml");
+        }
+    }
+
     private String loadCascadeFile(File cascadeDir, int id, String filename) throws IOException {
 
         InputStream is = getResources().openRawResource(id);
@@ -272,18 +297,35 @@ public class Main extends AppCompatActivity implements CvCameraViewListener2, RP
         }
 
         File cascadeDir = getDir("cascade", Context.MODE_PRIVATE);
+        String filesDir = getApplicationContext().getExternalFilesDir(null).getAbsolutePath();
+
+        // Time the stages on recorded frames
+        if (BENCHMARK_FRAMES != null) {
+            try {
+                Log.i(TAG, "Benchmark:\n" + RPPG.benchmark(new File(filesDir, BENCHMARK_FRAMES).getAbsolutePath(), BENCHMARK_FPS,
+                        ALGORITHM, DETECTOR, filesDir + "/benchmark", loadDetectorFile(cascadeDir)));
+            } catch (IOException e) {
+                Log.e(TAG, "Failed to load cascade. Exception thrown: " + e);
+            } catch (IllegalArgumentException e) {
+                Log.e(TAG, "Failed to run benchmark. Exception thrown: " + e);
+            }
+        }
 
         // Initialise rPPG
 
+        rPPGLoaded = false;
         try {
-            rPPG.load(this, ALGORITHM, width, height, TIME_BASE, 1,
-                    SAMPLING_FREQUENCY, RESCAN_FREQUENCY, MIN_SIGNAL_SIZE, MAX_SIGNAL_SIZE,
-                    getApplicationContext().getExternalFilesDir(null).getAbsolutePath(),
-                    loadCascadeFile(cascadeDir, R.raw.haarcascade_frontalface_alt, "haarcascade_frontalface_alt.xml"),
+            rPPG.load(this, ALGORITHM, DETECTOR, MAX_FACES, width, height, TIME_BASE, DOWNSAMPLE,
+                    SAMPLING_FREQUENCY, RESCAN_FREQUENCY, FRAME_BUDGET, ESTIMATION_HOP_SAMPLES, ESTIMATION_HOP_MILLIS, PROGRESSIVE_SIGNAL_SIZE, MIN_SIGNAL_SIZE, MAX_SIGNAL_SIZE,
+                    filesDir,
+                    loadDetectorFile(cascadeDir),
                     LOG, GUI);
+            rPPGLoaded = true;
             Log.i(TAG, "Loaded rPPG");
         } catch (IOException e) {
             Log.e(TAG, "Failed to load cascade. Exception thrown: " + e);
+        } catch (IllegalArgumentException e) {
+            Log.e(TAG, "Failed to load rPPG. Exception thrown: " + e);
         }
 
         cascadeDir.delete();
@@ -314,7 +356,9 @@ public class Main extends AppCompatActivity implements CvCameraViewListener2, RP
 
         // Send the frame to rPPG for processing
         // To C++
-        rPPG.processFrame(mRgba.getNativeObjAddr(), mGray.getNativeObjAddr(), time);
+        if (rPPGLoaded) {
+            rPPG.processFrame(mRgba.getNativeObjAddr(), mGray.getNativeObjAddr(), time);
+        }
 
         return mRgba;
     }
@@ -336,7 +380,10 @@ public class Main extends AppCompatActivity implements CvCameraViewListener2, RP
         // Release resources
         mGray.release();
         mRgba.release();
-        rPPG.exit();
+        if (rPPGLoaded) {
+            rPPG.exit();
+            rPPGLoaded = false;
+        }
     }
 
     /* PRRGListener methods */
@@ -352,7 +399,7 @@ public class Main extends AppCompatActivity implements CvCameraViewListener2, RP
         if (client.isActive) {
             queue.push(result);
         }
-        Log.i(TAG, "RPPGResult: " + result.getTime() + " – " + result.getMean());
+        Log.i(TAG, "RPPGResult: " + result.getTime() + " #" + result.getFace() + " – " + result.getMean() + (result.isProvisional() ? " (provisional)" : ""));
     }
 
     /* NetworkClientStateListener methods */
@@ -6,11 +6,23 @@ package com.prouast.heartbeat;
 public class RPPG {
 
     public enum RPPGAlgorithm {
-        g, pca, xminay
+        g, pca, xminay, pos, chrom
     }
 
+    public enum RPPGDetector {
+        haar, lbp
+    }
+
+    /* Indices into getCounters() */
+    public static final int COUNTER_FRAMES = 0;
+    public static final int COUNTER_DEADLINE_MISSES = 1;
+    public static final int COUNTER_SKIPPED_DRAWINGS = 2;
+    public static final int COUNTER_DEFERRED_ESTIMATIONS = 3;
+    public static final int COUNTER_DEFERRED_RESCANS = 4;
+
     /**
      * Listener must implement this interface.
+     * Results are delivered on the native signal processing thread, not on the camera thread.
      */
     public interface RPPGListener {
         void onRPPGResult(RPPGResult result);
@@ -20,14 +32,18 @@ public class RPPG {
         self = _initialise();
     }
 
+    /**
+     * Throws IllegalArgumentException if the face detector could not be loaded from classifierPath.
+     */
     public void load(RPPGListener listener,
-                     RPPGAlgorithm algorithm,
+                     RPPGAlgorithm algorithm, RPPGDetector detector, int maxFaces,
                      int width, int height, double timeBase, int downsample,
-                     double samplingFrequency, double rescanFrequency,
-                     int minSignalSize, int maxSignalSize,
+                     double samplingFrequency, double rescanFrequency, double frameBudget,
+                     int estimationHopSamples, int estimationHopMillis,
+                     double progressiveSignalSize, int minSignalSize, int maxSignalSize,
                      String logPath, String classifierPath,
                      boolean log, boolean gui) {
-        _load(self, listener, algorithm.ordinal(), width, height, timeBase, downsample, samplingFrequency, rescanFrequency, minSignalSize, maxSignalSize, logPath, classifierPath, log, gui);
+        _load(self, listener, algorithm.ordinal(), detector.ordinal(), maxFaces, width, height, timeBase, downsample, samplingFrequency, rescanFrequency, frameBudget, estimationHopSamples, estimationHopMillis, progressiveSignalSize, minSignalSize, maxSignalSize, logPath, classifierPath, log, gui);
     }
 
     public void exit() {
@@ -38,9 +54,34 @@ public class RPPG {
         _processFrame(self, frameRGB, frameGray, now);
     }
 
+    /**
+     * Counters of the frame budget since loading, indexed by the COUNTER_ constants.
+     * Call on the camera thread, between frames.
+     */
+    public long[] getCounters() {
+        return _getCounters(self);
+    }
+
+    /**
+     * Replays recorded frames through the whole pipeline at downsampling factors 1, 2 and 4.
+     * @param framePattern - printf pattern of the PNG frames by index from 0, e.g. frames/%04d.png
+     * @param fps - the frame rate of the recording
+     * @return CSV of the mean milliseconds per frame of each stage, one row per downsampling factor,
+     * followed by the mean milliseconds of the smoothing stage on synthetic windows and the largest difference
+     * of the incremental from the batch detrend relative to its error bound, which should not exceed 1
+     * Throws IllegalArgumentException if there are no frames or the face detector could not be loaded.
+     */
+    public static String benchmark(String framePattern, double fps,
+                                   RPPGAlgorithm algorithm, RPPGDetector detector,
+                                   String logPath, String classifierPath) {
+        return _benchmark(framePattern, fps, algorithm.ordinal(), detector.ordinal(), logPath, classifierPath);
+    }
+
     private long self = 0;
     private static native long _initialise();
-    private static native void _load(long self, RPPGListener listener, int algorithm, int width, int height, double timeBase, int downsample, double samplingFrequency, double rescanFrequency, int minSignalSize, int maxSignalSize, String logPath, String classifierPath, boolean log, boolean gui);
+    private static native void _load(long self, RPPGListener listener, int algorithm, int detector, int maxFaces, int width, int height, double timeBase, int downsample, double samplingFrequency, double rescanFrequency, double frameBudget, int estimationHopSamples, int estimationHopMillis, double progressiveSignalSize, int minSignalSize, int maxSignalSize, String logPath, String classifierPath, boolean log, boolean gui);
     private static native void _processFrame(long self, long frameRGB, long frameGray, long time);
     private static native void _exit(long self);
+    private static native long[] _getCounters(long self);
+    private static native String _benchmark(String framePattern, double fps, int algorithm, int detector, String logPath, String classifierPath);
 }
@@ -9,19 +9,25 @@ public class RPPGResult {
     private double min = Double.NaN;
     private double max = Double.NaN;
     private long time = 0L;
+    private int face = 0;
+    private boolean provisional = false;
 
     /**
      * Constructor
      * @param time
+     * @param face
      * @param mean
      * @param min
      * @param max
+     * @param provisional
      */
-    public RPPGResult(long time, double mean, double min, double max) {
+    public RPPGResult(long time, int face, double mean, double min, double max, boolean provisional) {
         this.time = time;
+        this.face = face;
         this.mean = mean;
         this.min = min;
         this.max = max;
+        this.provisional = provisional;
     }
 
     /**
@@ -32,6 +38,14 @@ public class RPPGResult {
         return time;
     }
 
+    /**
+     * Id of the face, which stays the same while the face is tracked
+     * @return face
+     */
+    public int getFace() {
+        return face;
+    }
+
     public double getMean() {
         return mean;
     }
@@ -43,4 +57,12 @@ public class RPPGResult {
     public double getMax() {
         return max;
     }
+
+    /**
+     * Whether the result was estimated before the window reached its minimum size
+     * @return provisional
+     */
+    public boolean isProvisional() {
+        return provisional;
+    }
 }
\ No newline at end of file
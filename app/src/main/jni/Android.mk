@@ -21,9 +21,12 @@ include $(CLEAR_VARS)
 OPENCV_INSTALL_MODULES:=on
 include $(OPENCV_PATH)/sdk/native/jni/OpenCV.mk
 LOCAL_MODULE := RPPG
-LOCAL_SRC_FILES := RPPG.cpp opencv.cpp com_prouast_heartbeat_RPPG.cpp
+LOCAL_SRC_FILES := RPPG.cpp BandSpectrum.cpp Benchmark.cpp DetectionWorker.cpp Face.cpp FaceDetector.cpp FaceSignal.cpp RoiSampler.cpp SignalBuffer.cpp SignalPipeline.cpp SignalWorker.cpp opencv.cpp simd.cpp com_prouast_heartbeat_RPPG.cpp
 LOCAL_C_INCLUDES += $(LOCAL_PATH)
 LOCAL_LDLIBS := -llog -ldl
+LOCAL_ARM_NEON := true
+# Single precision signal path by default with NEON, double precision instead (see Sample in simd.hpp)
+# LOCAL_CFLAGS += -DRPPG_DOUBLE_PRECISION
 include $(BUILD_SHARED_LIBRARY)
 
 include $(FFMPEG_PATH)/Android.mk
\ No newline at end of file
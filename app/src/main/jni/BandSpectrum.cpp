@@ -0,0 +1,238 @@
+//
+//  BandSpectrum.cpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#include "BandSpectrum.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace cv;
+using namespace std;
+
+// Samples moving by less than this fraction of the largest sample are not propagated
+#define CHANGE_TOLERANCE 1e-9
+// Never below the rounding of a single precision signal path
+#define SAMPLE_ROUNDING (16 * std::numeric_limits<Sample>::epsilon())
+// Recalculate all bins if more than this fraction of the window changed
+#define MAX_CHANGED_FRACTION 0.25
+
+void BandSpectrum::allocate(int length) {
+    this->length = length;
+    twiddle.resize(length);
+    for (int n = 0; n < length; n++) {
+        twiddle[n] = std::polar(1.0, -2 * CV_PI * n / length);
+    }
+    window.assign(length, 0);
+    bins.assign(length / 2 + 1, 0);
+    valid.assign(length / 2 + 1, false);
+    reset();
+}
+
+void BandSpectrum::setNarrowing(int narrowBins, int refreshInterval) {
+    this->narrowBins = narrowBins;
+    this->refreshInterval = refreshInterval;
+}
+
+void BandSpectrum::reset() {
+    rows = 0;
+    updates = 0;
+    narrowedUpdates = 0;
+    scale = 1;
+    from = 0;
+    to = -1;
+    peakBin = 0;
+    std::fill(window.begin(), window.end(), 0);
+    std::fill(valid.begin(), valid.end(), false);
+}
+
+// Direct DFT of bin k
+void BandSpectrum::recalculate(int k) {
+    std::complex<double> sum = 0;
+    int n = 0;
+    for (int i = 0; i < rows; i++) {
+        sum += window[i] * twiddle[n];
+        n += k;
+        if (n >= length) n -= length;
+    }
+    bins[k] = sum;
+    valid[k] = true;
+}
+
+// All tracked bins from one real FFT of x * scale
+void BandSpectrum::refill(const Mat &x, double scale) {
+
+    // Packed spectrum Re0, Re1, Im1, Re2, Im2, ... with Re(length/2) last for even lengths
+    const Mat &X = engine.transform(x, length);
+    const Sample *p = X.ptr<Sample>(0);
+
+    for (int k = from; k <= to; k++) {
+        if (k == 0) {
+            bins[k] = std::complex<double>(p[0], 0);
+        } else if (2 * k == length) {
+            bins[k] = std::complex<double>(p[length - 1], 0);
+        } else {
+            bins[k] = std::complex<double>(p[2 * k - 1], p[2 * k]);
+        }
+        bins[k] *= scale;
+        valid[k] = true;
+    }
+}
+
+void BandSpectrum::update(InputArray _x, int dropped, int low, int high, double scale) {
+
+    Mat x = _x.getMat();
+    CV_Assert(x.type() == SAMPLE_TYPE && x.cols == 1 && x.rows <= length);
+
+    // Band without the redundant upper half
+    low = std::max(low, 0);
+    high = std::min(high, length / 2);
+
+    // Bins to track, narrowed around the last peak if enabled
+    const int lastFrom = from;
+    const int lastTo = to;
+    if (narrowBins > 0 && rows > 0 && low <= peakBin && peakBin <= high && narrowedUpdates < refreshInterval) {
+        from = std::max(low, peakBin - narrowBins);
+        to = std::min(high, peakBin + narrowBins);
+        narrowedUpdates++;
+    } else {
+        from = low;
+        to = high;
+        narrowedUpdates = 0;
+    }
+
+    // Bins that are no longer tracked go stale
+    for (int k = lastFrom; k <= lastTo; k++) {
+        if (k < from || k > to) {
+            valid[k] = false;
+        }
+    }
+
+    // Windows that change everywhere start over every update, others once per analysis length
+    bool restart = !sliding || updates >= length;
+
+    if (!restart) {
+
+        // Remove dropped samples and shift the window to the front
+        dropped = std::min(dropped, rows);
+        if (dropped > 0) {
+            for (int k = from; k <= to; k++) {
+                if (valid[k]) {
+                    std::complex<double> removed = 0;
+                    for (int i = 0; i < dropped; i++) {
+                        removed += window[i] * twiddle[(int)((long long)k * i % length)];
+                    }
+                    bins[k] = (bins[k] - removed) * std::conj(twiddle[(int)((long long)k * dropped % length)]);
+                }
+            }
+            std::copy(window.begin() + dropped, window.begin() + rows, window.begin());
+            std::fill(window.begin() + rows - dropped, window.begin() + rows, 0);
+            rows -= dropped;
+        }
+
+        // Find samples that differ from the shifted window, which includes new samples
+        const int n = std::max(rows, x.rows);
+        double maxAbs = 0;
+        for (int i = 0; i < x.rows; i++) {
+            maxAbs = std::max(maxAbs, std::abs(x.at<Sample>(i, 0) * scale));
+        }
+        const double tolerance = std::max(CHANGE_TOLERANCE, (double)SAMPLE_ROUNDING) * maxAbs;
+        changed.clear();
+        for (int i = 0; i < n; i++) {
+            const double v = i < x.rows ? x.at<Sample>(i, 0) * scale : 0;
+            if (std::abs(v - window[i]) > tolerance) {
+                changed.push_back(i);
+            }
+        }
+
+        restart = changed.size() > MAX_CHANGED_FRACTION * n;
+    }
+
+    if (restart) {
+
+        // Start over
+        const int n = std::max(rows, x.rows);
+        for (int i = 0; i < n; i++) {
+            window[i] = i < x.rows ? x.at<Sample>(i, 0) * scale : 0;
+        }
+        std::fill(valid.begin(), valid.end(), false);
+        updates = 0;
+
+    } else {
+
+        // Propagate changed samples to the tracked bins
+        for (size_t c = 0; c < changed.size(); c++) {
+            const int i = changed[c];
+            const double v = i < x.rows ? x.at<Sample>(i, 0) * scale : 0;
+            const double delta = v - window[i];
+            for (int k = from; k <= to; k++) {
+                if (valid[k]) {
+                    bins[k] += delta * twiddle[(int)((long long)k * i % length)];
+                }
+            }
+            window[i] = v;
+        }
+        updates++;
+    }
+
+    rows = x.rows;
+    this->scale = scale;
+
+    // Bins that are not up to date, by direct DFTs of rows each or one FFT of the analysis length
+    int stale = 0;
+    for (int k = from; k <= to; k++) {
+        stale += valid[k] ? 0 : 1;
+    }
+    if ((double)stale * rows > length * std::log2((double)length)) {
+        refill(x, scale);
+    } else {
+        for (int k = from; k <= to; k++) {
+            if (!valid[k]) {
+                recalculate(k);
+            }
+        }
+    }
+
+    // Find the peak
+    peakBin = from;
+    double max = -1;
+    for (int k = from; k <= to; k++) {
+        const double power = std::norm(bins[k]);
+        if (power > max) {
+            max = power;
+            peakBin = k;
+        }
+    }
+}
+
+double BandSpectrum::refinedPeak() const {
+    if (peakBin <= from || peakBin >= to) {
+        return peakBin;
+    }
+    const double below = std::norm(bins[peakBin - 1]);
+    const double centre = std::norm(bins[peakBin]);
+    const double above = std::norm(bins[peakBin + 1]);
+    if (below <= 0 || centre <= 0 || above <= 0) {
+        return peakBin;
+    }
+    const double a = std::log(below), b = std::log(centre), c = std::log(above);
+    const double curvature = a - 2 * b + c;
+    if (curvature >= 0) {
+        return peakBin;
+    }
+    const double delta = 0.5 * (a - c) / curvature;
+    return peakBin + std::max(-0.5, std::min(0.5, delta));
+}
+
+void BandSpectrum::magnitude(OutputArray _b) const {
+    _b.create(length, 1, SAMPLE_TYPE);
+    Mat b = _b.getMat();
+    b.setTo(0);
+    for (int k = from; k <= to; k++) {
+        b.at<Sample>(k, 0) = scale > 0 ? std::abs(bins[k]) / scale : 0;
+    }
+}
@@ -0,0 +1,92 @@
+//
+//  BandSpectrum.hpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#ifndef BandSpectrum_hpp
+#define BandSpectrum_hpp
+
+#include <complex>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "opencv.hpp"
+#include "simd.hpp"
+
+// Incremental DFT of a band of frequencies over a sliding window.
+// The window is zero padded to a fixed analysis length, so samples entering, leaving or
+// changing only cost one complex multiply-add per tracked bin. Samples that change by less
+// than a relative tolerance are not propagated; a full recalculation once per analysis
+// length bounds the resulting drift. Once a large part of the window changed, or without
+// sliding, the bins are refilled from one real FFT instead.
+class BandSpectrum {
+
+public:
+
+    BandSpectrum() : length(0), narrowBins(0), refreshInterval(0), sliding(true) {;}
+
+    // Fix the analysis length, which must be at least the largest window
+    void allocate(int length);
+
+    // Only track bins within narrowBins of the last peak, with the whole band every refreshInterval updates
+    void setNarrowing(int narrowBins, int refreshInterval);
+
+    // Without sliding every update is transformed anew, for windows that change everywhere
+    void setSliding(bool sliding) { this->sliding = sliding; }
+
+    // Forget the previous window
+    void reset();
+
+    // Update for window _x * scale, which is the previous window without its first dropped samples
+    // plus new samples, and which may differ from it elsewhere. Tracks bins [low, high].
+    void update(cv::InputArray _x, int dropped, int low, int high, double scale = 1);
+
+    // Magnitudes of all bins of the unscaled window, zero for bins that are not tracked
+    void magnitude(cv::OutputArray _b) const;
+
+    // Bin with the highest magnitude among the tracked bins
+    int peak() const { return peakBin; }
+
+    // Fractional peak bin from a Gaussian through the peak and its neighbours, the peak itself at the
+    // edges of the tracked bins
+    double refinedPeak() const;
+
+    int size() const { return length; }
+    int first() const { return from; }
+    int last() const { return to; }
+
+private:
+
+    void recalculate(int k);
+    void refill(const cv::Mat &x, double scale);
+
+    int length;
+    int narrowBins;
+    int refreshInterval;
+    bool sliding;
+
+    // Window state
+    int rows;
+    int updates;
+    int narrowedUpdates;
+    double scale;
+    std::vector<double> window;
+
+    // Tracked bins
+    int from;
+    int to;
+    int peakBin;
+    std::vector<std::complex<double> > bins;
+    std::vector<bool> valid;
+
+    // Scratch
+    std::vector<int> changed;
+    cv::SpectralEngine engine;
+
+    // e^(-2πi * n / length)
+    std::vector<std::complex<double> > twiddle;
+};
+
+#endif /* BandSpectrum_hpp */
@@ -0,0 +1,184 @@
+//
+//  Benchmark.cpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#include "Benchmark.hpp"
+
+#include <cmath>
+#include <limits>
+#include <android/log.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "RPPG.hpp"
+#include "SignalPipeline.hpp"
+
+using namespace cv;
+using namespace std;
+
+// Settings of the replay, as in Main
+#define MAX_FACES 1
+#define TIME_BASE 0.001
+#define SAMPLING_FREQUENCY 1
+#define RESCAN_FREQUENCY 0.2
+#define ESTIMATION_HOP_SAMPLES 0
+#define ESTIMATION_HOP_MILLIS 250
+#define PROGRESSIVE_SIGNAL_SIZE 4.5
+#define MIN_SIGNAL_SIZE 6
+#define MAX_SIGNAL_SIZE 6
+
+// Synthetic windows for the stages alone
+#define STAGE_FPS 30
+#define STAGE_REPETITIONS 1000
+#define STREAM_SECONDS 600
+#define MAX_HOP 8
+
+#define LOG_TAG "Heartbeat::Benchmark"
+#define LOGD(...) ((void)__android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__))
+
+static const int DOWNSAMPLES[] = {1, 2, 4};
+static const int WINDOW_SECONDS[] = {3, 6, 12};
+
+// Pulse at 72 bpm with noise on a drifting baseline per column, deterministic
+static void synthesise(Mat &s, int rows, int cols = 1) {
+    s.create(rows, cols, SAMPLE_TYPE);
+    RNG rng(rows);
+    for (int j = 0; j < cols; j++) {
+        double baseline = 100;
+        for (int i = 0; i < rows; i++) {
+            baseline += cols > 1 ? rng.gaussian(0.5) : 0;
+            s.at<Sample>(i, j) = (Sample)(baseline + sin(2 * CV_PI * 1.2 * i / STAGE_FPS) + rng.gaussian(0.5));
+        }
+    }
+}
+
+// A frame as delivered by the camera, false if there is none
+static bool readFrame(const string &framePattern, int i, Mat &frameRGB, Mat &frameGray) {
+    Mat frame = imread(format(framePattern.c_str(), i), IMREAD_COLOR);
+    if (frame.empty()) {
+        return false;
+    }
+    cvtColor(frame, frameRGB, COLOR_BGR2RGBA);
+    cvtColor(frame, frameGray, COLOR_BGR2GRAY);
+    return true;
+}
+
+bool Benchmark::replay(const string &framePattern, double fps, ostream &report) {
+
+    Mat frameRGB, frameGray;
+    if (!readFrame(framePattern, 0, frameRGB, frameGray)) {
+        LOGD("No frames at %s", framePattern.c_str());
+        return false;
+    }
+    const int width = frameRGB.cols;
+    const int height = frameRGB.rows;
+    const double interval = 1 / (fps * TIME_BASE);
+
+    report << "downsample;frames;pyramid;tracking;scanning;sampling;drawing;signal\n";
+
+    for (size_t d = 0; d < sizeof(DOWNSAMPLES) / sizeof(DOWNSAMPLES[0]); d++) {
+
+        // Without a listener, with the drawing on and no frame budget, so that every stage runs on every frame
+        RPPG rppg;
+        if (!rppg.load(NULL, NULL, algorithm, detectorType, MAX_FACES, width, height, TIME_BASE, DOWNSAMPLES[d],
+                       SAMPLING_FREQUENCY, RESCAN_FREQUENCY, 0, ESTIMATION_HOP_SAMPLES, ESTIMATION_HOP_MILLIS,
+                       PROGRESSIVE_SIGNAL_SIZE, MIN_SIGNAL_SIZE, MAX_SIGNAL_SIZE,
+                       logPath, classifierPath, false, true)) {
+            return false;
+        }
+
+        for (int i = 0; readFrame(framePattern, i, frameRGB, frameGray); i++) {
+            rppg.processFrame(frameRGB, frameGray, (int64_t)((i + 1) * interval));
+        }
+        rppg.flush();
+
+        const RPPGTimings t = rppg.getTimings();
+        rppg.exit(NULL);
+
+        const double frames = max((double)t.frames, 1.0);
+        report << DOWNSAMPLES[d] << ";" << t.frames << ";"
+               << t.pyramid / frames << ";" << t.tracking / frames << ";" << t.scanning / frames << ";"
+               << t.sampling / frames << ";" << t.drawing / frames << ";"
+               << t.signal / max((double)t.signalFrames, 1.0) << "\n";
+
+        LOGD("Replayed %lld frames at 1/%d: pyramid %.2fms, tracking %.2fms, scanning %.2fms, sampling %.2fms, drawing %.2fms, signal %.2fms",
+             (long long)t.frames, DOWNSAMPLES[d], t.pyramid / frames, t.tracking / frames, t.scanning / frames,
+             t.sampling / frames, t.drawing / frames, t.signal / max((double)t.signalFrames, 1.0));
+    }
+
+    return true;
+}
+
+void Benchmark::smoothing(ostream &report) {
+
+    report << "rows;smoothing\n";
+
+    for (size_t w = 0; w < sizeof(WINDOW_SECONDS) / sizeof(WINDOW_SECONDS[0]); w++) {
+
+        Mat s;
+        synthesise(s, WINDOW_SECONDS[w] * STAGE_FPS);
+
+        // Warm up once, so that the output and scratch are allocated as on every later frame
+        SmoothStage stage;
+        stage.update(s, STAGE_FPS);
+
+        const int64 start = getTickCount();
+        for (int i = 0; i < STAGE_REPETITIONS; i++) {
+            stage.update(s, STAGE_FPS);
+        }
+        const double mean = (getTickCount() - start) * 1000.0 / getTickFrequency() / STAGE_REPETITIONS;
+
+        report << s.rows << ";" << mean << "\n";
+        LOGD("Smoothing %d rows: %.4fms", s.rows, mean);
+    }
+}
+
+bool Benchmark::detrending(ostream &report) {
+
+    report << "rows;lambda;hop;errorOfBound\n";
+
+    Mat stream;
+    synthesise(stream, STREAM_SECONDS * STAGE_FPS, 3);
+
+    bool passed = true;
+    for (size_t w = 0; w < sizeof(WINDOW_SECONDS) / sizeof(WINDOW_SECONDS[0]); w++) {
+        for (int hop = 1; hop <= MAX_HOP; hop *= 2) {
+
+            // The detrending stage runs with lambda at the frame rate
+            const int rows = WINDOW_SECONDS[w] * STAGE_FPS;
+            const int lambda = STAGE_FPS;
+            IncrementalDetrendFilter incremental;
+            DetrendFilter batch;
+            Mat a, b, c;
+
+            // Slide the window along the stream, worst difference relative to the bound of each window
+            double worst = 0;
+            int start = 0;
+            int length = 0;
+            while (start + length + hop <= stream.rows) {
+                length += hop;
+                const int dropped = max(length - rows, 0);
+                start += dropped;
+                length -= dropped;
+                a = stream.rowRange(start, start + length);
+                incremental.apply(a, b, lambda, dropped);
+                batch.apply(a, c, lambda);
+                for (int j = 0; j < a.cols; j++) {
+                    double minValue, maxValue, error;
+                    minMaxIdx(a.col(j), &minValue, &maxValue);
+                    error = norm(b.col(j), c.col(j), NORM_INF);
+                    worst = max(worst, error / max(incremental.errorBound(maxValue - minValue), std::numeric_limits<double>::min()));
+                }
+            }
+
+            passed = passed && worst <= 1;
+            report << rows << ";" << lambda << ";" << hop << ";" << worst << "\n";
+            LOGD("Incremental detrend of %d rows by %d: %.3f of its error bound", rows, hop, worst);
+        }
+    }
+
+    return passed;
+}
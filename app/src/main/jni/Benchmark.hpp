@@ -0,0 +1,45 @@
+//
+//  Benchmark.hpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+#include <ostream>
+#include <string>
+
+// Reproducible timings of the pipeline on a device.
+// Recorded frames are PNG files named by a printf pattern of the frame index from 0, e.g. frames/%04d.png
+// as extracted from a recording. They are timestamped at a fixed frame rate and replayed as fast as possible,
+// so that runs on the same recording are comparable across builds.
+class Benchmark {
+
+public:
+
+    Benchmark(int algorithm, int detectorType, const std::string &classifierPath, const std::string &logPath) :
+        algorithm(algorithm), detectorType(detectorType), classifierPath(classifierPath), logPath(logPath) {;}
+
+    // Replay the frames at downsampling factors 1, 2 and 4, writing the mean milliseconds per frame of each stage
+    // as CSV. Returns false if there are no frames or the detector fails to load.
+    bool replay(const std::string &framePattern, double fps, std::ostream &report);
+
+    // Time the smoothing stage alone on synthetic windows of increasing length, writing the mean
+    // milliseconds per update as CSV
+    void smoothing(std::ostream &report);
+
+    // Compare IncrementalDetrendFilter with DetrendFilter over a long synthetic stream, writing the largest
+    // difference relative to its error bound as CSV. Returns false if the bound is exceeded.
+    bool detrending(std::ostream &report);
+
+private:
+
+    int algorithm;
+    int detectorType;
+    std::string classifierPath;
+    std::string logPath;
+};
+
+#endif /* Benchmark_hpp */
@@ -0,0 +1,124 @@
+//
+//  DetectionWorker.cpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#include "DetectionWorker.hpp"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace cv;
+using namespace std;
+
+bool DetectionWorker::load(FaceDetectorType type, const string &path, double scale) {
+    stop();
+    this->scale = scale;
+    detector = FaceDetector::create(type);
+    if (!detector || !detector->load(path)) {
+        detector.release();
+        return false;
+    }
+    running = true;
+    busy = false;
+    ready = false;
+    thread = std::thread(&DetectionWorker::run, this);
+    return true;
+}
+
+void DetectionWorker::stop() {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            return;
+        }
+        running = false;
+        generation++;
+    }
+    condition.notify_one();
+    thread.join();
+}
+
+bool DetectionWorker::submit(const Mat &frameGray, Rect window, Size minSize, Size maxSize, bool single, int64_t time) {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        if (!running || busy || ready || window.area() == 0) {
+            return false;
+        }
+        frameGray(window).copyTo(input);
+        this->window = window;
+        this->minSize = minSize;
+        this->maxSize = maxSize;
+        this->single = single;
+        this->time = time;
+        requestGeneration = generation;
+        busy = true;
+    }
+    condition.notify_one();
+    return true;
+}
+
+bool DetectionWorker::poll(vector<Rect> &boxes, int64_t &time) {
+    lock_guard<std::mutex> lock(mutex);
+    if (!ready) {
+        return false;
+    }
+    ready = false;
+    if (requestGeneration != generation) {
+        return false;
+    }
+    boxes.swap(this->boxes);
+    time = this->time;
+    return true;
+}
+
+bool DetectionWorker::pending() {
+    lock_guard<std::mutex> lock(mutex);
+    return busy || ready;
+}
+
+void DetectionWorker::cancel() {
+    lock_guard<std::mutex> lock(mutex);
+    generation++;
+    ready = false;
+}
+
+void DetectionWorker::latency(double &last, double &average) {
+    lock_guard<std::mutex> lock(mutex);
+    last = lastLatency;
+    average = meanLatency;
+}
+
+void DetectionWorker::run() {
+
+    unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+
+        condition.wait(lock, [this] { return !running || busy; });
+        if (!running) {
+            break;
+        }
+
+        // The request stays untouched while busy, so it is read without the lock
+        lock.unlock();
+
+        // Detect on a downscaled copy of the window and map the boxes back to full resolution
+        vector<Rect> found;
+        resize(input, scaled, Size(), scale, scale, INTER_AREA);
+        detector->detect(scaled, Size(minSize.width * scale, minSize.height * scale),
+                         Size(maxSize.width * scale, maxSize.height * scale), single, found);
+        for (size_t i = 0; i < found.size(); i++) {
+            found[i] = Rect(window.x + cvRound(found[i].x / scale), window.y + cvRound(found[i].y / scale),
+                            cvRound(found[i].width / scale), cvRound(found[i].height / scale));
+        }
+
+        lock.lock();
+        boxes.swap(found);
+        lastLatency = detector->latency();
+        meanLatency = detector->averageLatency();
+        busy = false;
+        ready = true;
+    }
+}
@@ -0,0 +1,84 @@
+//
+//  DetectionWorker.hpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#ifndef DetectionWorker_hpp
+#define DetectionWorker_hpp
+
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "FaceDetector.hpp"
+
+// Runs face detection on a background thread, one request at a time.
+// The caller submits a frame and polls for the boxes on later frames, so that
+// the cascade never blocks the camera thread. Boxes are in full frame coordinates.
+class DetectionWorker {
+
+public:
+
+    DetectionWorker() : scale(1), running(false), busy(false), ready(false), generation(0), lastLatency(0), meanLatency(0) {;}
+    ~DetectionWorker() { stop(); }
+
+    // Load the detector backend and start the thread. Detection runs on the frame scaled by scale.
+    bool load(FaceDetectorType type, const std::string &path, double scale);
+
+    // Stop the thread, discarding a running request
+    void stop();
+
+    // Detect in the window of the frame, which is copied. Returns false if a request is still running.
+    bool submit(const cv::Mat &frameGray, cv::Rect window, cv::Size minSize, cv::Size maxSize, bool single, int64_t time);
+
+    // Take the boxes of the last request once it has finished, with the time it was submitted for
+    bool poll(std::vector<cv::Rect> &boxes, int64_t &time);
+
+    // Whether a request is running or its result has not been taken
+    bool pending();
+
+    // Discard the result of the running request
+    void cancel();
+
+    // Milliseconds the backend took for the last request and on average
+    void latency(double &last, double &average);
+    const char *name() const { return detector ? detector->name() : "none"; }
+
+private:
+
+    void run();
+
+    cv::Ptr<FaceDetector> detector;
+    double scale;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool running;
+    bool busy;
+    bool ready;
+    int generation;
+
+    // Request
+    cv::Mat input;
+    cv::Rect window;
+    cv::Size minSize;
+    cv::Size maxSize;
+    bool single;
+    int64_t time;
+    int requestGeneration;
+
+    // Result
+    std::vector<cv::Rect> boxes;
+    cv::Mat scaled;
+    double lastLatency;
+    double meanLatency;
+};
+
+#endif /* DetectionWorker_hpp */
@@ -0,0 +1,387 @@
+//
+//  Face.cpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#include "Face.hpp"
+
+#include <cmath>
+#include <sstream>
+#include <android/log.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/video/video.hpp>
+
+using namespace cv;
+using namespace std;
+
+#define MAX_CORNERS 10
+#define MIN_CORNERS 5
+#define QUALITY_LEVEL 0.01
+#define MIN_DISTANCE 25
+#define TRACKING_WINDOW 21
+#define TRACKING_LEVELS 3
+#define TRACKING_FALLBACK_LEVEL 1
+#define MIN_CORRELATION_SIZE 16
+#define MIN_CORRELATION_RESPONSE 0.1
+#define MAX_TRACKING_ERROR 2
+#define MAX_SCALE_DRIFT 0.25
+#define MAX_COLOUR_JUMP 0.05
+#define CHEEK_REGIONS false
+#define SKIN_GATE true
+#define SKIN_CR_LOW 133
+#define SKIN_CR_HIGH 173
+#define SKIN_CB_LOW 77
+#define SKIN_CB_HIGH 127
+#define MIN_SKIN 0.2                                                            // Fraction of the pixels of a region that must pass
+
+#define LOG_TAG "Heartbeat::Face"
+#define LOGD(...) ((void)__android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__))
+
+static Rect scaleRect(Rect r, double scale) {
+    return Rect(r.x * scale, r.y * scale, r.width * scale, r.height * scale);
+}
+
+Face::Face(int id, const RPPGSettings &settings) : misses(0), id(id), settings(settings),
+    rescanFlag(false), sampled(false), placedWidth(0), trackingConfidence(1), colourConfidence(1) {
+
+    motion = Mat::eye(3, 3, CV_64F);
+
+    // Regions of the face as fractions of its box, the forehead first as the primary signal.
+    // Only the primary signal is estimated, so the cheeks are sampled only if asked for.
+    sampler.add("forehead", Rect2d(0.3, 0.1, 0.4, 0.15));
+    if (CHEEK_REGIONS) {
+        sampler.add("left_cheek", Rect2d(0.15, 0.55, 0.2, 0.2));
+        sampler.add("right_cheek", Rect2d(0.65, 0.55, 0.2, 0.2));
+    }
+
+    // Leave hair, eyebrows and background out of the means
+    if (SKIN_GATE) {
+        sampler.gate(SKIN_CR_LOW, SKIN_CR_HIGH, SKIN_CB_LOW, SKIN_CB_HIGH, MIN_SKIN);
+    }
+}
+
+void Face::buildPyramid(const Mat &frameGray, vector<Mat> &pyramid) {
+    buildOpticalFlowPyramid(frameGray, pyramid, Size(TRACKING_WINDOW, TRACKING_WINDOW), TRACKING_LEVELS,
+                            true, BORDER_REFLECT_101, BORDER_CONSTANT, false);
+}
+
+void Face::place(const Mat &frameGray, Rect box) {
+
+    // The regions jump with the next sample if the face was tracked before
+    rescanFlag = sampled;
+
+    this->box = box;
+    detectCorners(frameGray);
+    sampler.place(scaleRect(box, settings.sampleScale));
+
+    // Confident again until tracking says otherwise
+    placedWidth = box.width;
+    trackingConfidence = 1;
+    colourConfidence = 1;
+}
+
+void Face::beginScan() {
+    motion = Mat::eye(3, 3, CV_64F);
+    scannedBox = box;
+}
+
+Rect Face::followMotion(Rect found) const {
+    Contour2f boxCoords;
+    boxCoords.push_back(found.tl());
+    boxCoords.push_back(found.br());
+    Contour2f transformedBoxCoords;
+    cv::transform(boxCoords, transformedBoxCoords, motion.rowRange(0, 2));
+    return Rect(transformedBoxCoords[0], transformedBoxCoords[1]);
+}
+
+void Face::detectCorners(const Mat &frameGray) {
+
+    // Define tracking region
+    Point points[1][4];
+    points[0][0] = Point(box.tl().x + 0.22 * box.width,
+                         box.tl().y + 0.21 * box.height);
+    points[0][1] = Point(box.tl().x + 0.78 * box.width,
+                         box.tl().y + 0.21 * box.height);
+    points[0][2] = Point(box.tl().x + 0.70 * box.width,
+                         box.tl().y + 0.50 * box.height);
+    points[0][3] = Point(box.tl().x + 0.30 * box.width,
+                         box.tl().y + 0.50 * box.height);
+    const Point *pts[1] = {points[0]};
+    int npts[] = {4};
+
+    // Only within the bounding rectangle of the region, with a mask of that size
+    Rect region = boundingRect(vector<Point>(points[0], points[0] + 4));
+    region &= Rect(0, 0, frameGray.cols, frameGray.rows);
+    corners.clear();
+    if (region.area() == 0) {
+        return;
+    }
+    trackingRegion.create(region.size(), CV_8UC1);
+    trackingRegion.setTo(ZERO);
+    fillPoly(trackingRegion, pts, npts, 1, WHITE, LINE_8, 0, Point(-region.x, -region.y));
+
+    // Apply corner detection
+    goodFeaturesToTrack(frameGray(region),
+                        corners,
+                        MAX_CORNERS,
+                        QUALITY_LEVEL,
+                        (double)MIN_DISTANCE / settings.downsample,
+                        trackingRegion,
+                        3,
+                        false,
+                        0.04);
+
+    for (size_t i = 0; i < corners.size(); i++) {
+        corners[i] += Point2f(region.x, region.y);
+    }
+}
+
+bool Face::track(const Mat &frameGray, const vector<Mat> &lastPyramid, const vector<Mat> &pyramid) {
+
+    // Make sure enough corners are available
+    if (corners.size() < MIN_CORNERS) {
+        detectCorners(frameGray);
+    }
+
+    Contour2f corners_1;
+    Contour2f corners_0;
+    vector<uchar> cornersFound_1;
+    vector<uchar> cornersFound_0;
+    Mat err;
+
+    // Track face features with Kanade-Lucas-Tomasi (KLT) algorithm
+    const Size window(TRACKING_WINDOW, TRACKING_WINDOW);
+    calcOpticalFlowPyrLK(lastPyramid, pyramid, corners, corners_1, cornersFound_1, err, window, TRACKING_LEVELS);
+
+    // Backtrack once to make it more robust
+    calcOpticalFlowPyrLK(pyramid, lastPyramid, corners_1, corners_0, cornersFound_0, err, window, TRACKING_LEVELS);
+
+    // Exclude no-good corners
+    Contour2f corners_1v;
+    Contour2f corners_0v;
+    double error = 0;
+    for (size_t j = 0; j < corners.size(); j++) {
+        double e = cv::norm(corners[j]-corners_0[j]);
+        if (cornersFound_1[j] && cornersFound_0[j]
+            && e < MAX_TRACKING_ERROR) {
+            corners_0v.push_back(corners_0[j]);
+            corners_1v.push_back(corners_1[j]);
+            error += e;
+        } else {
+            LOGD("Mis!");
+        }
+    }
+
+    Mat transform;
+    bool fallback = corners_1v.size() < MIN_CORNERS;
+
+    if (!fallback) {
+
+        // Confidence in the corners that survived, and in how closely they backtracked
+        trackingConfidence = fmin((double)corners_1v.size() / corners.size(),
+                                  1 - error / corners_1v.size() / MAX_TRACKING_ERROR);
+
+        // Save updated features
+        corners = corners_1v;
+
+        // Estimate similarity transform, the backtracking has removed the outliers
+        transform = estimateSimilarity(corners_0v, corners_1v);
+
+    } else {
+
+        LOGD("Not enough corners left on face %d, correlating the face patch", id);
+
+        transform = correlate(lastPyramid, pyramid);
+
+        if (transform.empty()) {
+            LOGD("Tracking face %d failed! Not enough corners left.", id);
+            return false;
+        }
+
+        // The patch only follows translations
+        trackingConfidence = 0;
+    }
+
+    if (transform.total() > 0) {
+        move(transform);
+    }
+
+    // Scale drift since the face was placed
+    if (placedWidth > 0 && box.width > 0) {
+        double drift = fabs(std::log((double)box.width / placedWidth));
+        trackingConfidence = fmin(trackingConfidence, 1 - drift / MAX_SCALE_DRIFT);
+    }
+
+    // Fresh corners where the face moved to, so that KLT takes over again
+    if (fallback) {
+        detectCorners(frameGray);
+    }
+
+    return true;
+}
+
+void Face::move(const Mat &transform) {
+
+    // Accumulate the motion since the last detection request
+    Mat step = Mat::eye(3, 3, CV_64F);
+    transform.copyTo(step.rowRange(0, 2));
+    motion = step * motion;
+
+    // Update box
+    Contour2f boxCoords;
+    boxCoords.push_back(box.tl());
+    boxCoords.push_back(box.br());
+    Contour2f transformedBoxCoords;
+    cv::transform(boxCoords, transformedBoxCoords, transform);
+    box = Rect(transformedBoxCoords[0], transformedBoxCoords[1]);
+
+    // Update regions, whose translation scales with the sampled frame
+    Mat sampledTransform = transform.clone();
+    sampledTransform.at<double>(0, 2) *= settings.sampleScale;
+    sampledTransform.at<double>(1, 2) *= settings.sampleScale;
+    sampler.transform(sampledTransform);
+}
+
+Mat Face::correlate(const vector<Mat> &lastPyramid, const vector<Mat> &pyramid) {
+
+    if (pyramid.size() <= 2 * TRACKING_FALLBACK_LEVEL || lastPyramid.size() <= 2 * TRACKING_FALLBACK_LEVEL) {
+        return Mat();
+    }
+
+    // Face patch on a coarser pyramid level, whose images are every other entry
+    const Mat &previous = lastPyramid[2 * TRACKING_FALLBACK_LEVEL];
+    const Mat &current = pyramid[2 * TRACKING_FALLBACK_LEVEL];
+    const double scale = 1 << TRACKING_FALLBACK_LEVEL;
+    Rect patch = Rect(box.x / scale, box.y / scale, box.width / scale, box.height / scale);
+    patch &= Rect(0, 0, previous.cols, previous.rows);
+    if (patch.width < MIN_CORRELATION_SIZE || patch.height < MIN_CORRELATION_SIZE) {
+        return Mat();
+    }
+
+    previous(patch).convertTo(previousPatch, CV_32F);
+    current(patch).convertTo(currentPatch, CV_32F);
+    if (hanning.size() != patch.size()) {
+        createHanningWindow(hanning, patch.size(), CV_32F);
+    }
+
+    // Translation of the patch, if the correlation peak is distinct enough
+    double response = 0;
+    Point2d shift = phaseCorrelate(previousPatch, currentPatch, hanning, &response);
+    if (response < MIN_CORRELATION_RESPONSE) {
+        return Mat();
+    }
+
+    Mat transform = Mat::eye(2, 3, CV_64F);
+    transform.at<double>(0, 2) = shift.x * scale;
+    transform.at<double>(1, 2) = shift.y * scale;
+    return transform;
+}
+
+void Face::sample(const Mat &frameRGB, int64_t time, FaceSample &sample) {
+
+    // Take the means of every region
+    const bool continued = sampled && !rescanFlag;
+    double previous[3];
+    std::copy(sampler.means(0), sampler.means(0) + 3, previous);
+    sampler.sample(frameRGB);
+
+    // A pulse changes the colour by far less than a region that slipped off the skin
+    if (continued) {
+        const double *current = sampler.means(0);
+        double jump = 0;
+        for (int c = 0; c < 3; c++) {
+            jump = fmax(jump, fabs(current[c] - previous[c]) / fmax(previous[c], 1));
+        }
+        colourConfidence = fmin(colourConfidence, 1 - jump / MAX_COLOUR_JUMP);
+    }
+
+    sample.kind = FaceSample::sample;
+    sample.face = id;
+    sample.time = time;
+    sample.rescan = rescanFlag;
+    sample.regions = sampler.count();
+    for (int i = 0; i < sampler.count(); i++) {
+        std::copy(sampler.means(i), sampler.means(i) + 3, sample.means[i]);
+    }
+
+    sampled = true;
+    rescanFlag = false;
+}
+
+void Face::draw(Mat &frameRGB, const FaceDisplay &display) const {
+
+    // Geometry back in the coordinates of the full frame
+    const Rect box = scaleRect(this->box, settings.downsample);
+    const double regionScale = settings.downsample / settings.sampleScale;
+
+    // Draw regions
+    for (int i = 0; i < sampler.count(); i++) {
+        rectangle(frameRGB, scaleRect(sampler.rect(i), regionScale), GREEN);
+    }
+
+    // Draw bounding box
+    rectangle(frameRGB, box, RED);
+
+    // Draw signal
+    const Mat &s_f = display.signal;
+    const Mat &powerSpectrum = display.spectrum;
+    if (!s_f.empty() && !powerSpectrum.empty()) {
+
+        // Display of signals with fixed dimensions
+        double displayHeight = box.height/2.0;
+        double displayWidth = box.width*0.8;
+
+        // Draw signal
+        double vmin, vmax;
+        Point pmin, pmax;
+        minMaxLoc(s_f, &vmin, &vmax, &pmin, &pmax);
+        double heightMult = displayHeight/(vmax - vmin);
+        double widthMult = displayWidth/(s_f.rows - 1);
+        double drawAreaTlX = box.tl().x + box.width + 20;
+        double drawAreaTlY = box.tl().y;
+        Point p1(drawAreaTlX, drawAreaTlY + (vmax - s_f.at<Sample>(0, 0))*heightMult);
+        Point p2;
+        for (int i = 1; i < s_f.rows; i++) {
+            p2 = Point(drawAreaTlX + i * widthMult, drawAreaTlY + (vmax - s_f.at<Sample>(i, 0))*heightMult);
+            line(frameRGB, p1, p2, RED, 2);
+            p1 = p2;
+        }
+
+        // Draw powerSpectrum
+        const int first = display.first;
+        const int last = display.last;
+        minMaxLoc(powerSpectrum.rowRange(first, last + 1), &vmin, &vmax, &pmin, &pmax);
+        heightMult = displayHeight/(vmax - vmin);
+        widthMult = displayWidth/(last - first);
+        drawAreaTlX = box.tl().x + box.width + 20;
+        drawAreaTlY = box.tl().y + box.height/2.0;
+        p1 = Point(drawAreaTlX, drawAreaTlY + (vmax - powerSpectrum.at<Sample>(first, 0))*heightMult);
+        for (int i = first + 1; i <= last; i++) {
+            p2 = Point(drawAreaTlX + (i - first) * widthMult, drawAreaTlY + (vmax - powerSpectrum.at<Sample>(i, 0)) * heightMult);
+            line(frameRGB, p1, p2, RED, 2);
+            p1 = p2;
+        }
+    }
+
+    std::stringstream ss;
+
+    // Draw BPM text
+    ss.precision(3);
+    ss << display.meanBpm << " bpm";
+    putText(frameRGB, ss.str(), Point(box.tl().x, box.tl().y - 10), FONT_HERSHEY_PLAIN, 2, RED, 2);
+
+    // Draw face and FPS text
+    ss.str("");
+    ss << "#" << id << "  " << display.fps << " fps";
+    putText(frameRGB, ss.str(), Point(box.tl().x, box.br().y + 40), FONT_HERSHEY_PLAIN, 2, GREEN, 2);
+
+    // Draw corners
+    for (int i = 0; i < corners.size(); i++) {
+        const Point2f corner = corners[i] * settings.downsample;
+        line(frameRGB, Point(corner.x-5,corner.y), Point(corner.x+5,corner.y), GREEN, 1);
+        line(frameRGB, Point(corner.x,corner.y-5), Point(corner.x,corner.y+5), GREEN, 1);
+    }
+}
@@ -0,0 +1,132 @@
+//
+//  Face.hpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#ifndef Face_hpp
+#define Face_hpp
+
+#include <algorithm>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "opencv.hpp"
+#include "RoiSampler.hpp"
+#include "SignalPipeline.hpp"
+
+// Settings shared by all faces
+struct RPPGSettings {
+    RPPGAlgorithm algorithm;
+    int maxSignalSize;
+    int minSignalSize;
+    double progressiveSignalSize;
+    double samplingFrequency;
+    int estimationHopSamples;
+    int estimationHopMillis;
+    double timeBase;
+    int downsample;                                                             // Faces are tracked on frames reduced by this factor
+    double sampleScale;                                                         // From tracking coordinates to those of the sampled frame
+    bool logMode;
+    bool guiMode;
+    std::string logfilepath;
+};
+
+// The means of the regions of a face in one frame, handed from the camera thread to the signal worker.
+// Frame markers close the samples of a frame, lost markers end the signal of a face.
+struct FaceSample {
+    enum Kind { sample, lost, frame };
+    Kind kind;
+    int face;
+    int64_t time;
+    bool rescan;
+    bool defer;                                                                 // Frame markers: estimations due in this frame may wait
+    int regions;
+    double means[RoiSampler::MAX_REGIONS][3];
+};
+
+// The signal state of a face as last published for drawing
+struct FaceDisplay {
+    FaceDisplay() : first(0), last(0), meanBpm(0), fps(0) {;}
+    cv::Mat signal;
+    cv::Mat spectrum;
+    int first;
+    int last;
+    double meanBpm;
+    double fps;
+};
+
+// A tracked face with its regions, identified by a stable id. Tracking and sampling read the frame
+// and run on the camera thread; the signal of the face is processed elsewhere from its samples.
+class Face {
+
+public:
+
+    typedef std::vector<cv::Point2f> Contour2f;
+
+    Face(int id, const RPPGSettings &settings);
+
+    // Pyramid of a frame as used for tracking
+    static void buildPyramid(const cv::Mat &frameGray, std::vector<cv::Mat> &pyramid);
+
+    // Place the face at a detected box, flagging the jump in the next sample if it was tracked before
+    void place(const cv::Mat &frameGray, cv::Rect box);
+
+    // Follow the face from the last frame, false if it was lost
+    bool track(const cv::Mat &frameGray, const std::vector<cv::Mat> &lastPyramid, const std::vector<cv::Mat> &pyramid);
+
+    // Remember the box a detection was requested for, and move boxes found by it along with the face since
+    void beginScan();
+    cv::Rect scanBox() const { return scannedBox; }
+    cv::Rect followMotion(cv::Rect found) const;
+
+    // Take the means of the regions of the frame
+    void sample(const cv::Mat &frameRGB, int64_t time, FaceSample &sample);
+
+    void draw(cv::Mat &frameRGB, const FaceDisplay &display) const;
+
+    // How well the face has been followed since it was placed, between 0 and 1. Combines the
+    // forward-backward error and the survival of the corners, the drift of the box scale and
+    // jumps of the colour of the primary region.
+    double getConfidence() const { return std::min(trackingConfidence, colourConfidence); }
+
+    int getId() const { return id; }
+    cv::Rect getBox() const { return box; }
+
+    // Consecutive whole frame scans that missed the face
+    int misses;
+
+private:
+
+    void detectCorners(const cv::Mat &frameGray);
+    cv::Mat correlate(const std::vector<cv::Mat> &lastPyramid, const std::vector<cv::Mat> &pyramid);
+    void move(const cv::Mat &transform);
+
+    int id;
+    const RPPGSettings &settings;
+
+    // Tracking
+    cv::Rect box;
+    Contour2f corners;
+    cv::Mat trackingRegion;
+    cv::Mat motion;
+    cv::Rect scannedBox;
+    bool rescanFlag;
+    bool sampled;
+    int placedWidth;
+    double trackingConfidence;
+    double colourConfidence;
+
+    // Fallback tracking
+    cv::Mat previousPatch;
+    cv::Mat currentPatch;
+    cv::Mat hanning;
+
+    // Regions
+    RoiSampler sampler;
+};
+
+#endif /* Face_hpp */
@@ -0,0 +1,83 @@
+//
+//  FaceDetector.cpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#include "FaceDetector.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace cv;
+using namespace std;
+
+// Feature types as returned by CascadeClassifier::getFeatureType
+#define HAAR_FEATURES 0
+#define LBP_FEATURES 1
+
+#define SCALE_FACTOR 1.1
+#define MIN_NEIGHBOURS 2
+#define SCALES_PER_BAND 3
+
+Ptr<FaceDetector> FaceDetector::create(FaceDetectorType type) {
+    switch (type) {
+        case lbpDetector:
+        case haarDetector:
+            return Ptr<FaceDetector>(new CascadeDetector(type));
+        default:
+            return Ptr<FaceDetector>();
+    }
+}
+
+void FaceDetector::detect(const Mat &image, Size minSize, Size maxSize, bool single, vector<Rect> &boxes) {
+    int64 start = getTickCount();
+    detectFaces(image, minSize, maxSize, single, boxes);
+    lastLatency = (getTickCount() - start) * 1000.0 / getTickFrequency();
+    calls++;
+    meanLatency += (lastLatency - meanLatency) / calls;
+}
+
+bool CascadeDetector::load(const string &path) {
+
+    if (!classifier.load(path)) {
+        return false;
+    }
+
+    // The cascade must match the backend, so that its latency is reported under the right name.
+    // Old style cascades are always Haar, and have no feature evaluator to ask.
+    const int expected = type == lbpDetector ? LBP_FEATURES : HAAR_FEATURES;
+    const int features = classifier.isOldFormatCascade() ? HAAR_FEATURES : classifier.getFeatureType();
+    return features == expected;
+}
+
+static bool isBigger(const Rect &a, const Rect &b) {
+    return a.area() > b.area();
+}
+
+void CascadeDetector::detectFaces(const Mat &image, Size minSize, Size maxSize, bool single, vector<Rect> &boxes) {
+
+    if (!single || maxSize.area() == 0) {
+        classifier.detectMultiScale(image, boxes, SCALE_FACTOR, MIN_NEIGHBOURS, 0, minSize, maxSize);
+        return;
+    }
+
+    // The Haar search flags are ignored by new style cascades, so stop early here: scan a few scales
+    // at a time from maxSize down, overlapping by one, and keep the biggest face of the first band that hits
+    const double band = pow(SCALE_FACTOR, SCALES_PER_BAND);
+    Size upper = maxSize;
+    while (true) {
+        Size lower = Size(max(cvRound(upper.width / band), minSize.width), max(cvRound(upper.height / band), minSize.height));
+        classifier.detectMultiScale(image, boxes, SCALE_FACTOR, MIN_NEIGHBOURS, 0, lower, upper);
+        if (!boxes.empty()) {
+            std::nth_element(boxes.begin(), boxes.begin(), boxes.end(), isBigger);
+            boxes.resize(1);
+            return;
+        }
+        if (lower.width <= minSize.width || lower.height <= minSize.height) {
+            return;
+        }
+        upper = Size(cvRound(lower.width * SCALE_FACTOR), cvRound(lower.height * SCALE_FACTOR));
+    }
+}
@@ -0,0 +1,72 @@
+//
+//  FaceDetector.hpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#ifndef FaceDetector_hpp
+#define FaceDetector_hpp
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+enum FaceDetectorType { haarDetector, lbpDetector };
+
+// A face detector backend, timing each call so that backends can be compared per device
+class FaceDetector {
+
+public:
+
+    // Null for an unknown type
+    static cv::Ptr<FaceDetector> create(FaceDetectorType type);
+
+    FaceDetector() : calls(0), lastLatency(0), meanLatency(0) {;}
+    virtual ~FaceDetector() {;}
+
+    virtual bool load(const std::string &path) = 0;
+
+    // Faces of at least minSize and, unless empty, at most maxSize in a gray image.
+    // With single and a maxSize, the search stops at the largest scales with a hit and returns the biggest face there.
+    void detect(const cv::Mat &image, cv::Size minSize, cv::Size maxSize, bool single, std::vector<cv::Rect> &boxes);
+
+    // Milliseconds taken by the last call and on average
+    double latency() const { return lastLatency; }
+    double averageLatency() const { return meanLatency; }
+
+    virtual const char *name() const = 0;
+
+protected:
+
+    virtual void detectFaces(const cv::Mat &image, cv::Size minSize, cv::Size maxSize, bool single, std::vector<cv::Rect> &boxes) = 0;
+
+private:
+
+    int calls;
+    double lastLatency;
+    double meanLatency;
+};
+
+// Haar or LBP cascade, the file loaded must have the features of the type
+class CascadeDetector : public FaceDetector {
+
+public:
+
+    CascadeDetector(FaceDetectorType type) : type(type) {;}
+
+    bool load(const std::string &path);
+    const char *name() const { return type == lbpDetector ? "lbp" : "haar"; }
+
+protected:
+
+    void detectFaces(const cv::Mat &image, cv::Size minSize, cv::Size maxSize, bool single, std::vector<cv::Rect> &boxes);
+
+private:
+
+    FaceDetectorType type;
+    cv::CascadeClassifier classifier;
+};
+
+#endif /* FaceDetector_hpp */
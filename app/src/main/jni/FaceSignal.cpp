@@ -0,0 +1,256 @@
+//
+//  FaceSignal.cpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#include "FaceSignal.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <android/log.h>
+#include <opencv2/core/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+#define LOW_BPM 42
+#define HIGH_BPM 240
+#define SEC_PER_MIN 60
+#define MAX_FPS 60
+#define NARROW_BPM 0
+#define NARROW_REFRESH 30
+#define INTERPOLATE_BPM false
+#define REFINE_PEAK true
+#define MIN_PROGRESSIVE_PERIODS 3
+#define MAX_DEFERRED_ESTIMATIONS 8
+
+#define LOG_TAG "Heartbeat::FaceSignal"
+#define LOGD(...) ((void)__android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__))
+
+FaceSignal::FaceSignal(int id, const RPPGSettings &settings) : id(id), settings(settings),
+    dropped(0), fps(0), low(0), high(0), ready(false),
+    estimated(false), deferredNow(false), deferred(0), samplesSinceEstimation(0), lastEstimationTime(0), estimationInterval(0), lastSamplingTime(0),
+    estimatedBpm(0), previousBpm(0), bpm(0), provisional(false), reportedProvisional(false),
+    meanBpm(0), minBpm(0), maxBpm(0) {
+
+    // Filtering stages for the algorithm
+    pipeline = SignalPipeline::create(settings.algorithm);
+
+    // The spectrum is analysed on the longest window at the highest frame rate, zero padded while the window is shorter
+    // and up to a length the FFT handles well
+    spectrum.allocate(getOptimalDFTSize(settings.maxSignalSize * MAX_FPS + 1));
+    spectrum.setSliding(pipeline->isSliding());
+
+    // Per face logs
+    std::ostringstream path;
+    path << settings.logfilepath << "_face=" << id;
+    logfilepath = path.str();
+}
+
+void FaceSignal::push(const FaceSample &sample) {
+
+    // Allocate the raw signal buffers for the longest window at the highest frame rate
+    if (signals.empty()) {
+        signals.resize(sample.regions);
+        for (size_t i = 0; i < signals.size(); i++) {
+            signals[i].allocate(settings.maxSignalSize * MAX_FPS + 1, 3);
+        }
+    }
+
+    SignalBuffer &signal = signals[0];
+
+    // Update fps
+    fps = signal.getFps(settings.timeBase);
+
+    // Remove old values from buffers
+    while (signal.size() > fps * settings.maxSignalSize || signal.full()) {
+        for (size_t i = 0; i < signals.size(); i++) {
+            signals[i].pop();
+        }
+        dropped++;
+    }
+
+    // Add new values of every region and rescan flag to raw signal buffers
+    for (size_t i = 0; i < signals.size(); i++) {
+        signals[i].push(sample.means[i], sample.time, sample.rescan);
+    }
+    samplesSinceEstimation++;
+
+    // Update fps
+    fps = signal.getFps(settings.timeBase);
+
+    // Update band spectrum limits
+    low = (int)(signal.size() * LOW_BPM / SEC_PER_MIN / fps);
+    high = (int)(signal.size() * HIGH_BPM / SEC_PER_MIN / fps) + 1;
+
+    // If valid signal is large enough: estimate once per hop, report every frame.
+    // In progressive mode, shorter windows give provisional results until the minimum size is reached.
+    // Progressive windows span at least a few periods of the lowest rate in the band, shorter ones can't resolve it.
+    const double startSignalSize = settings.progressiveSignalSize > 0 ?
+        fmin(fmax(settings.progressiveSignalSize, MIN_PROGRESSIVE_PERIODS * SEC_PER_MIN / (double)LOW_BPM), settings.minSignalSize) :
+        settings.minSignalSize;
+    ready = signal.size() >= fps * startSignalSize;
+}
+
+bool FaceSignal::process(int64_t time, bool defer) {
+
+    deferredNow = false;
+
+    if (!ready) {
+        return false;
+    }
+
+    bool due = isEstimationDue(time);
+
+    // While the worker is behind the estimation waits, but never for the first result
+    if (due && defer && estimated && deferred < MAX_DEFERRED_ESTIMATIONS) {
+        LOGD("Deferring estimation of face %d", id);
+        deferred++;
+        deferredNow = true;
+        due = false;
+    }
+
+    if (due) {
+
+        // Filtering
+        pipeline->update(signals[0], dropped, fps, low, high);
+        s_f = pipeline->output();
+
+        // Logging
+        if (settings.logMode) {
+            std::ofstream log;
+            std::ostringstream filepath;
+            filepath << logfilepath << "_signal_" << time << ".csv";
+            log.open(filepath.str().c_str());
+            pipeline->log(log);
+            log.close();
+        }
+
+        // PSD estimation
+        estimateHeartrate(time);
+        dropped = 0;
+        samplesSinceEstimation = 0;
+        deferred = 0;
+    }
+
+    return reportHeartrate(time);
+}
+
+void FaceSignal::estimateHeartrate(int64_t time) {
+
+    // Band limits on the analysis length of the spectrum
+    const int total = spectrum.size();
+    const int bandLow = (int)(total * LOW_BPM / SEC_PER_MIN / fps);
+    const int bandHigh = (int)(total * HIGH_BPM / SEC_PER_MIN / fps) + 1;
+
+    // Update the in-band bins with the samples that changed since the last estimation
+    spectrum.setNarrowing((int)(total * NARROW_BPM / SEC_PER_MIN / fps), NARROW_REFRESH);
+    spectrum.update(s_f, dropped, bandLow, bandHigh, pipeline->scale());
+
+    if (settings.guiMode || settings.logMode) {
+        spectrum.magnitude(powerSpectrum);
+    }
+
+    if (!s_f.empty()) {
+
+        // calculate BPM, between bins if refined
+        double peak = REFINE_PEAK ? spectrum.refinedPeak() : spectrum.peak();
+        double estimate = peak * fps / total * SEC_PER_MIN;
+        previousBpm = estimated ? estimatedBpm : estimate;
+        estimatedBpm = estimate;
+        estimationInterval = estimated ? time - lastEstimationTime : 0;
+        lastEstimationTime = time;
+        estimated = true;
+
+        LOGD("Face=%d FPS=%f Vals=%d Peak=%d BPM=%f Smoothing=%.3fms", id, fps, s_f.rows, spectrum.peak(), estimatedBpm, pipeline->smoothingTime());
+
+        // Logging
+        if (settings.logMode) {
+            std::ofstream log;
+            std::ostringstream filepath;
+            filepath << logfilepath << "_estimation_" << time << ".csv";
+            log.open(filepath.str().c_str());
+            log << "i;powerSpectrum\n";
+            for (int i = spectrum.first(); i <= spectrum.last(); i++) {
+                log << i << ";";
+                log << powerSpectrum.at<Sample>(i, 0) << "\n";
+            }
+            log.close();
+        }
+    }
+}
+
+bool FaceSignal::isEstimationDue(int64_t time) const {
+    if (!estimated) {
+        return true;
+    } else if (settings.estimationHopSamples > 0) {
+        return samplesSinceEstimation >= settings.estimationHopSamples;
+    } else if (settings.estimationHopMillis > 0) {
+        return (time - lastEstimationTime) * settings.timeBase * 1000 >= settings.estimationHopMillis;
+    } else {
+        return true;
+    }
+}
+
+bool FaceSignal::reportHeartrate(int64_t time) {
+
+    // Between estimations, hold the last estimate or move to it from the one before over one hop
+    if (INTERPOLATE_BPM && estimationInterval > 0) {
+        double progress = fmin((double)(time - lastEstimationTime) / estimationInterval, 1);
+        bpm = previousBpm + (estimatedBpm - previousBpm) * progress;
+    } else {
+        bpm = estimatedBpm;
+    }
+    bpms.push_back(bpm);
+    provisional = provisional || signals[0].size() < fps * settings.minSignalSize;
+
+    if ((time - lastSamplingTime) * settings.timeBase >= 1/settings.samplingFrequency) {
+        lastSamplingTime = time;
+
+        cv::sort(bpms, bpms, SORT_EVERY_COLUMN);
+
+        // average calculated BPMs since last sampling time
+        meanBpm = mean(bpms)(0);
+        minBpm = bpms.at<double>(0, 0);
+        maxBpm = bpms.at<double>(bpms.rows-1, 0);
+
+        reportedProvisional = provisional;
+        provisional = false;
+
+        bpms.pop_back(bpms.rows);
+        return true;
+    }
+
+    return false;
+}
+
+void FaceSignal::log(ostream &logfile, ostream &logfileDetailed, int64_t time) const {
+
+    if (lastSamplingTime == time || lastSamplingTime == 0) {
+        logfile << time << ";";
+        logfile << id << ";";
+        logfile << true << ";";
+        logfile << meanBpm << ";";
+        logfile << minBpm << ";";
+        logfile << maxBpm << "\n";
+        logfile.flush();
+    }
+
+    logfileDetailed << time << ";";
+    logfileDetailed << id << ";";
+    logfileDetailed << true << ";";
+    logfileDetailed << bpm << "\n";
+    logfileDetailed.flush();
+}
+
+void FaceSignal::display(FaceDisplay &display) const {
+    display.signal = s_f.clone();
+    display.spectrum = powerSpectrum.clone();
+    display.first = spectrum.first();
+    display.last = spectrum.last();
+    display.meanBpm = meanBpm;
+    display.fps = fps;
+}
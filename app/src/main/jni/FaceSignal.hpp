@@ -0,0 +1,97 @@
+//
+//  FaceSignal.hpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#ifndef FaceSignal_hpp
+#define FaceSignal_hpp
+
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "opencv.hpp"
+#include "BandSpectrum.hpp"
+#include "Face.hpp"
+#include "SignalBuffer.hpp"
+#include "SignalPipeline.hpp"
+
+// The raw signals of the regions of a face with its filtering and estimation state.
+// Fed with the samples of its face, and touching nothing but its own state,
+// so that the signals of several faces can be processed in parallel.
+class FaceSignal {
+
+public:
+
+    FaceSignal(int id, const RPPGSettings &settings);
+
+    // Append the means of a sample, dropping samples that left the window
+    void push(const FaceSample &sample);
+
+    // Filter and estimate once the signal is large enough, true if a result is due.
+    // A due estimation may be deferred to a later frame, for a few frames at most.
+    bool process(int64_t time, bool defer);
+
+    void log(std::ostream &logfile, std::ostream &logfileDetailed, int64_t time) const;
+
+    // Copy of the state for drawing on another thread
+    void display(FaceDisplay &display) const;
+
+    int getId() const { return id; }
+    bool isReady() const { return ready; }
+    bool wasDeferred() const { return deferredNow; }                           // In the last process()
+
+    // The result of the last process() that returned true
+    double getMeanBpm() const { return meanBpm; }
+    double getMinBpm() const { return minBpm; }
+    double getMaxBpm() const { return maxBpm; }
+    bool isProvisional() const { return reportedProvisional; }
+
+private:
+
+    void estimateHeartrate(int64_t time);
+    bool isEstimationDue(int64_t time) const;
+    bool reportHeartrate(int64_t time);
+
+    int id;
+    const RPPGSettings &settings;
+    std::string logfilepath;
+
+    // Raw signals of the regions, the first one is the primary signal
+    std::vector<SignalBuffer> signals;
+
+    // Filtering
+    cv::Ptr<SignalPipeline> pipeline;
+    int dropped;
+    double fps;
+    int low;
+    int high;
+    bool ready;
+
+    // Estimation
+    cv::Mat s_f;
+    BandSpectrum spectrum;
+    cv::Mat1d bpms;
+    cv::Mat powerSpectrum;
+    bool estimated;
+    bool deferredNow;
+    int deferred;
+    int samplesSinceEstimation;
+    int64_t lastEstimationTime;
+    int64_t estimationInterval;
+    int64_t lastSamplingTime;
+    double estimatedBpm;
+    double previousBpm;
+    double bpm;
+    bool provisional;
+    bool reportedProvisional;
+    double meanBpm;
+    double minBpm;
+    double maxBpm;
+};
+
+#endif /* FaceSignal_hpp */
@@ -8,6 +8,8 @@
 
 #include "RPPG.hpp"
 
+#include <algorithm>
+#include <thread>
 #include <android/log.h>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -19,577 +21,478 @@
 using namespace cv;
 using namespace std;
 
-#define LOW_BPM 42
-#define HIGH_BPM 240
 #define REL_MIN_FACE_SIZE 0.2
-#define SEC_PER_MIN 60
-#define MAX_CORNERS 10
-#define MIN_CORNERS 5
-#define QUALITY_LEVEL 0.01
-#define MIN_DISTANCE 25
+#define DETECTION_WIDTH 320
+#define SAMPLE_DOWNSAMPLED false
+#define RESCAN_PADDING 0.5
+#define MATCH_DISTANCE 0.5
+#define MAX_FACE_MISSES 1
+#define MIN_RESCAN_INTERVAL 0.25
+#define MIN_TRACKING_CONFIDENCE 0.5
+#define COST_SMOOTHING 0.1
+#define MAX_DEFERRED_RESCANS 15
+#define MAX_WORKER_LAG 2
 
 #define LOG_TAG "Heartbeat::RPPG"
 #define LOGD(...) ((void)__android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__))
 
+static bool isBigger(const Rect &a, const Rect &b) {
+    return a.area() > b.area();
+}
+
+static void updateCost(double &cost, int64 ticks) {
+    cost += COST_SMOOTHING * (ticks * 1000.0 / getTickFrequency() - cost);
+}
+
 bool RPPG::load(jobject listener, JNIEnv *jenv,
-                int algorithm,
+                int algorithm, int detectorType, const int maxFaces,
                 const int width, const int height, const double timeBase, const int downsample,
-                const double samplingFrequency, const double rescanFrequency,
-                const int minSignalSize, const int maxSignalSize,
+                const double samplingFrequency, const double rescanFrequency, const double frameBudget,
+                const int estimationHopSamples, const int estimationHopMillis,
+                const double progressiveSignalSize, const int minSignalSize, const int maxSignalSize,
                 const string &logPath, const string &classifierPath,
                 const bool log, const bool gui) {
 
-    this->algorithm = (RPPGAlgorithm)algorithm;
-    this->guiMode = gui;
-    this->lastSamplingTime = 0;
-    this->logMode = log;
-    this->minFaceSize = Size(min(width, height) * REL_MIN_FACE_SIZE, min(width, height) * REL_MIN_FACE_SIZE);
-    this->maxSignalSize = maxSignalSize;
-    this->minSignalSize = minSignalSize;
-    this->rescanFlag = false;
+    settings.algorithm = (RPPGAlgorithm)algorithm;
+    settings.estimationHopMillis = estimationHopMillis;
+    settings.estimationHopSamples = estimationHopSamples;
+    settings.guiMode = gui;
+    settings.logMode = log;
+    settings.maxSignalSize = maxSignalSize;
+    settings.minSignalSize = minSignalSize;
+    settings.progressiveSignalSize = progressiveSignalSize;
+    settings.samplingFrequency = samplingFrequency;
+    settings.timeBase = timeBase;
+    settings.downsample = max(downsample, 1);
+    settings.sampleScale = SAMPLE_DOWNSAMPLED ? 1 : settings.downsample;
+    const int processingSize = min(width, height) / settings.downsample;
+    this->minFaceSize = Size(processingSize * REL_MIN_FACE_SIZE, processingSize * REL_MIN_FACE_SIZE);
+    this->maxFaces = max(maxFaces, 1);
+    this->nextId = 0;
+    this->lastScanTime = 0;
+    this->scanningWholeFrame = false;
     this->rescanFrequency = rescanFrequency;
-    this->samplingFrequency = samplingFrequency;
-    this->timeBase = timeBase;
+    this->frameBudget = max(frameBudget, 0.0);
+    this->samplingCost = 0;
+    this->drawingCost = 0;
+    this->rescanCost = 0;
+    this->rescanDeferrals = 0;
+    this->counters = RPPGCounters();
+    this->timings = RPPGTimings();
+
+    LOGD("Using algorithm %d for up to %d faces, downsampling by %d, frame budget %.1fms", algorithm, this->maxFaces, settings.downsample, this->frameBudget);
+
+    // Load classifiers and start detecting in the background, on a copy of the downsampled frame scaled to at most DETECTION_WIDTH.
+    // Without a detector no face is ever found, so fail before holding on to anything.
+    const double detectionScale = fmin(1, (double)DETECTION_WIDTH * settings.downsample / max(width, height));
+    if (!detector.load((FaceDetectorType)detectorType, classifierPath, detectionScale)) {
+        LOGD("Failed to load detector %d", detectorType);
+        return false;
+    }
 
-    LOGD("Using algorithm %f", algorithm);
+    if (listener != NULL) {
 
-    // Save reference to Java VM
-    jenv->GetJavaVM(&jvm);
+        // Save reference to Java VM
+        jenv->GetJavaVM(&jvm);
 
-    // Save global reference to listener object
-    this->listener = jenv->NewGlobalRef(listener);
+        // Save global reference to listener object
+        this->listener = jenv->NewGlobalRef(listener);
+
+        // Look up the classes here, the worker thread that reports results can't find application classes
+        resultClass = (jclass)jenv->NewGlobalRef(jenv->FindClass("com/prouast/heartbeat/RPPGResult"));
+        resultConstructor = jenv->GetMethodID(resultClass, "<init>", "(JIDDDZ)V");
+        listenerMethod = jenv->GetMethodID(jenv->GetObjectClass(listener), "onRPPGResult", "(Lcom/prouast/heartbeat/RPPGResult;)V");
+    }
 
-    // Load classifiers
-    classifier.load(classifierPath);
-    
     // Setting up logfilepath
     std::ostringstream path_1;
     path_1 << logPath << "_a=" << algorithm << "_min=" << minSignalSize << "_max=" << maxSignalSize << "_ds=" << downsample;
-    this->logfilepath = path_1.str();
+    settings.logfilepath = path_1.str();
     
-    // Logging bpm according to sampling frequency
-    std::ostringstream path_2;
-    path_2 << logfilepath << "_bpm.csv";
-    logfile.open(path_2.str().c_str());
-    logfile << "time;face_valid;mean;min;max\n";
-    logfile.flush();
-    
-    // Logging bpm detailed
-    std::ostringstream path_3;
-    path_3 << logfilepath << "_bpmAll.csv";
-    logfileDetailed.open(path_3.str().c_str());
-    logfileDetailed << "time;face_valid;bpm\n";
-    logfileDetailed.flush();
+    // Process the signals of the faces on a worker, which also logs
+    signals.load(settings, this);
 
     return true;
 }
 
 void RPPG::exit(JNIEnv *jenv) {
-    jenv->DeleteGlobalRef(listener);
+    detector.stop();
+    signals.stop();
+    faces.clear();
+    if (listener != NULL) {
+        jenv->DeleteGlobalRef(listener);
+        jenv->DeleteGlobalRef(resultClass);
+    }
+    jvm = NULL;
     listener = NULL;
-    logfile.close();
-    logfileDetailed.close();
+    resultClass = NULL;
 }
 
 void RPPG::processFrame(Mat &frameRGB, Mat &frameGray, int64_t time) {
 
     // Set time
     this->time = time;
+
+    int64 start = getTickCount();
+
+    // Track and detect on a copy reduced by the downsampling factor, geometry of the faces stays in its coordinates
+    Mat gray = frameGray;
+    if (settings.downsample > 1) {
+        resize(frameGray, processingGray, Size(), 1.0 / settings.downsample, 1.0 / settings.downsample, INTER_AREA);
+        gray = processingGray;
+    }
+
+    // Pyramid of this frame, the previous one for the next frame
+    Face::buildPyramid(gray, pyramid);
+    int64 pyramidTicks = getTickCount();
     
-    if (!faceValid) {
-        
+    // Take the boxes of a detection that finished since the last frame
+    vector<Rect> boxes;
+    int64_t detectionTime;
+    bool detected = detector.poll(boxes, detectionTime);
+
+    // Keep tracking while the detector runs, dropping the faces that were lost
+    for (size_t i = 0; i < faces.size();) {
+        LOGD("Tracking face %d", faces[i]->getId());
+        if (faces[i]->track(gray, lastPyramid, pyramid)) {
+            i++;
+        } else {
+            removeFace(i);
+        }
+    }
+    int64 trackingTicks = getTickCount();
+
+    // Shed what the rest of the frame can do without if it would overrun the budget
+    const double msPerTick = 1000.0 / getTickFrequency();
+    const bool rescanDue = !detected && !faces.empty() && !detector.pending() && isRescanDue();
+    const Degradation degradation = degrade((trackingTicks - start) * msPerTick, rescanDue);
+
+    bool scanned = true;
+    if (detected) {
+
+        LOGD("Detection finished after %lld", (long long)(time - detectionTime));
+
+        updateFaces(gray, boxes);
+
+    } else if (!detector.pending() && faces.empty()) {
+
         LOGD("Not valid, finding a new face");
-        
+
         lastScanTime = time;
-        detectFace(frameRGB, frameGray);
-        
-    } else if ((time - lastScanTime) * timeBase >= 1/rescanFrequency) {
-        
-        LOGD("Valid, but rescanning face");
-        
+        detectFaces(gray, false);
+
+    } else if (rescanDue && degradation < deferRescan) {
+
+        LOGD("Valid, but rescanning faces");
+
         lastScanTime = time;
-        detectFace(frameRGB, frameGray);
-        rescanFlag = true;
+        detectFaces(gray, true);
 
     } else {
-        
-        LOGD("Tracking face");
-        
-        trackFace(frameGray);
-    }
-    
-    if (faceValid) {
 
-        // Update fps
-        fps = getFps(t, timeBase);
+        scanned = false;
+    }
+    int64 scanningTicks = getTickCount();
+    if (scanned) {
+        updateCost(rescanCost, scanningTicks - trackingTicks);
+    }
 
-        // Remove old values from buffer
-        while (s.rows > fps * maxSignalSize) {
-            push(s);
-            push(t);
-            push(re);
-        }
+    // Sample at full resolution, or on a reduced copy if so configured. This is never shed.
+    Mat sampled = frameRGB;
+    if (settings.sampleScale < settings.downsample && !faces.empty()) {
+        resize(frameRGB, processingRGB, gray.size(), 0, 0, INTER_AREA);
+        sampled = processingRGB;
+    }
 
-        assert(s.rows == t.rows && s.rows == re.rows);
-
-        // New values
-        Scalar means = mean(frameRGB, mask);
-
-        // Add new values to raw signal buffer
-        double values[] = {means(0), means(1), means(2)};
-        s.push_back(Mat(1, 3, CV_64F, values));
-        t.push_back<long>(time);
-
-        // Save rescan flag
-        re.push_back<bool>(rescanFlag);
-
-        // Update fps
-        fps = getFps(t, timeBase);
-
-        // Update band spectrum limits
-        low = (int)(s.rows * LOW_BPM / SEC_PER_MIN / fps);
-        high = (int)(s.rows * HIGH_BPM / SEC_PER_MIN / fps) + 1;
-        
-        // If valid signal is large enough: estimate
-        if (s.rows >= fps * minSignalSize) {
-
-            // Filtering
-            switch (algorithm) {
-                case g:
-                    extractSignal_g();
-                    break;
-                case pca:
-                    extractSignal_pca();
-                    break;
-                case xminay:
-                    extractSignal_xminay();
-                    break;
-            }
-
-            // PSD estimation
-            estimateHeartrate();
-
-            // Log
-            log();
-        }
+    // Hand the samples of every face and the end of the frame to the signal worker
+    for (size_t i = 0; i < faces.size(); i++) {
+        FaceSample sample;
+        faces[i]->sample(sampled, time, sample);
+        signals.push(sample);
+    }
+    FaceSample end;
+    end.kind = FaceSample::frame;
+    end.time = time;
+    end.defer = isWorkerBehind();
+    signals.push(end);
+    int64 samplingTicks = getTickCount();
+    updateCost(samplingCost, samplingTicks - scanningTicks);
+
+    timings.frames++;
+    timings.pyramid += (pyramidTicks - start) * msPerTick;
+    timings.tracking += (trackingTicks - pyramidTicks) * msPerTick;
+    timings.scanning += (scanningTicks - trackingTicks) * msPerTick;
+    timings.sampling += (samplingTicks - scanningTicks) * msPerTick;
+
+    if (settings.logMode) {
+        LOGD("Stages at 1/%d: pyramid %.2fms, tracking %.2fms, scanning %.2fms, sampling %.2fms", settings.downsample,
+             (pyramidTicks - start) * msPerTick, (trackingTicks - pyramidTicks) * msPerTick,
+             (scanningTicks - trackingTicks) * msPerTick, (samplingTicks - scanningTicks) * msPerTick);
+    }
 
-        if (guiMode) {
-            draw(frameRGB);
+    // Draw with the signal state the worker published last
+    if (settings.guiMode && degradation < skipDrawing) {
+        for (size_t i = 0; i < faces.size(); i++) {
+            FaceDisplay display;
+            signals.display(faces[i]->getId(), display);
+            faces[i]->draw(frameRGB, display);
         }
+        const int64 drawingTicks = getTickCount() - samplingTicks;
+        updateCost(drawingCost, drawingTicks);
+        timings.drawing += drawingTicks * msPerTick;
     }
 
-    if (!guiMode) {
+    if (!settings.guiMode) {
         // Indicator
         frameRGB.setTo(BLACK);
-        // circle(frameRGB, Point(1250, 100), 25, faceValid ? GREEN : RED, -1, 8, 0);
     }
 
-    rescanFlag = false;
-    
-    frameGray.copyTo(lastFrameGray);
+    // Count the degradations and the frames that overran the budget anyway
+    if (frameBudget > 0) {
+        counters.frames++;
+        if (settings.guiMode && degradation >= skipDrawing) {
+            counters.skippedDrawings++;
+        }
+        if (degradation >= deferRescan) {
+            counters.deferredRescans++;
+            rescanDeferrals++;
+        } else {
+            rescanDeferrals = 0;
+        }
+        const double elapsed = (getTickCount() - start) * msPerTick;
+        if (elapsed > frameBudget) {
+            counters.deadlineMisses++;
+            LOGD("Frame took %.2fms of %.2fms, missed %lld of %lld", elapsed, frameBudget,
+                 (long long)counters.deadlineMisses, (long long)counters.frames);
+        }
+    }
+
+    pyramid.swap(lastPyramid);
 }
 
-void RPPG::detectFace(Mat &frameRGB, Mat &frameGray) {
-    
-    LOGD("Scanning for faces…");
-    
-    // Detect faces with Haar classifier
-    vector<Rect> boxes;
-    classifier.detectMultiScale(frameGray, boxes, 1.1, 2, CV_HAAR_SCALE_IMAGE, minFaceSize);
-    
-    if (boxes.size() > 0) {
-        
-        LOGD("Found a face");
-        
-        setNearestBox(boxes);
-        detectCorners(frameGray);
-        updateROI();
-        updateMask(frameGray);
-        faceValid = true;
+bool RPPG::isRescanDue() {
 
-    } else {
-        
-        LOGD("Found no face");
-        invalidateFace();
+    const double elapsed = (time - lastScanTime) * settings.timeBase;
+
+    // At least once per rescan period, as a safety net
+    if (elapsed >= 1/rescanFrequency) {
+        return true;
+    } else if (elapsed < MIN_RESCAN_INTERVAL) {
+        return false;
     }
-}
 
-void RPPG::setNearestBox(vector<Rect> boxes) {
-    int index = 0;
-    Point p = box.tl() - boxes.at(0).tl();
-    int min = p.x * p.x + p.y * p.y;
-    for (int i = 1; i < boxes.size(); i++) {
-        p = box.tl() - boxes.at(i).tl();
-        int d = p.x * p.x + p.y * p.y;
-        if (d < min) {
-            min = d;
-            index = i;
+    // Sooner if tracking of a face becomes doubtful
+    for (size_t i = 0; i < faces.size(); i++) {
+        if (faces[i]->getConfidence() < MIN_TRACKING_CONFIDENCE) {
+            LOGD("Face %d tracked with confidence %.2f", faces[i]->getId(), faces[i]->getConfidence());
+            return true;
         }
     }
-    box = boxes.at(index);
+    return false;
 }
 
-void RPPG::detectCorners(Mat &frameGray) {
-    
-    // Define tracking region
-    Mat trackingRegion = Mat::zeros(frameGray.rows, frameGray.cols, CV_8UC1);
-    Point points[1][4];
-    points[0][0] = Point(box.tl().x + 0.22 * box.width,
-                         box.tl().y + 0.21 * box.height);
-    points[0][1] = Point(box.tl().x + 0.78 * box.width,
-                         box.tl().y + 0.21 * box.height);
-    points[0][2] = Point(box.tl().x + 0.70 * box.width,
-                         box.tl().y + 0.50 * box.height);
-    points[0][3] = Point(box.tl().x + 0.30 * box.width,
-                         box.tl().y + 0.50 * box.height);
-    const Point *pts[1] = {points[0]};
-    int npts[] = {4};
-    fillPoly(trackingRegion, pts, npts, 1, WHITE);
-    
-    // Apply corner detection
-    goodFeaturesToTrack(frameGray,
-                        corners,
-                        MAX_CORNERS,
-                        QUALITY_LEVEL,
-                        MIN_DISTANCE,
-                        trackingRegion,
-                        3,
-                        false,
-                        0.04);
+RPPGCounters RPPG::getCounters() const {
+
+    // Estimations are counted where the signal worker actually deferred them
+    RPPGCounters result = counters;
+    result.deferredEstimations = signals.getDeferredEstimations();
+    return result;
 }
 
-void RPPG::trackFace(Mat &frameGray) {
-    
-    // Make sure enough corners are available
-    if (corners.size() < MIN_CORNERS) {
-        detectCorners(frameGray);
-    }
-
-    Contour2f corners_1;
-    Contour2f corners_0;
-    vector<uchar> cornersFound_1;
-    vector<uchar> cornersFound_0;
-    Mat err;
-
-    // Track face features with Kanade-Lucas-Tomasi (KLT) algorithm
-    calcOpticalFlowPyrLK(lastFrameGray, frameGray, corners, corners_1, cornersFound_1, err);
-
-    // Backtrack once to make it more robust
-    calcOpticalFlowPyrLK(frameGray, lastFrameGray, corners_1, corners_0, cornersFound_0, err);
-
-    // Exclude no-good corners
-    Contour2f corners_1v;
-    Contour2f corners_0v;
-    for (size_t j = 0; j < corners.size(); j++) {
-        if (cornersFound_1[j] && cornersFound_0[j]
-            && cv::norm(corners[j]-corners_0[j]) < 2) {
-            corners_0v.push_back(corners_0[j]);
-            corners_1v.push_back(corners_1[j]);
-        } else {
-            LOGD("Mis!");
-        }
+RPPGTimings RPPG::getTimings() const {
+    RPPGTimings result = timings;
+    result.signalFrames = signals.getProcessedFrames();
+    result.signal = signals.getProcessingTicks() * 1000.0 / getTickFrequency();
+    return result;
+}
+
+void RPPG::flush() {
+    while (signals.getProcessedTime() < time) {
+        std::this_thread::yield();
     }
+}
 
-    if (corners_1v.size() >= MIN_CORNERS) {
+RPPG::Degradation RPPG::degrade(double elapsed, bool rescanDue) {
 
-        // Save updated features
-        corners = corners_1v;
+    if (frameBudget <= 0) {
+        return fullFrame;
+    }
 
-        // Estimate affine transform
-        Mat transform = estimateRigidTransform(corners_0v, corners_1v, false);
+    // Project the rest of the frame on this thread, the estimation runs on the signal worker
+    const double drawing = settings.guiMode ? drawingCost : 0;
+    const double rescan = rescanDue ? rescanCost : 0;
+    double projected = elapsed + samplingCost + drawing + rescan;
 
-        if (transform.total() > 0) {
+    // Shed in order until it fits, the samples always stay. A rescan waits for a limited number of frames only.
+    if (projected <= frameBudget) {
+        return fullFrame;
+    }
+    projected -= drawing;
+    if (projected <= frameBudget || !rescanDue || rescanDeferrals >= MAX_DEFERRED_RESCANS) {
+        return skipDrawing;
+    }
+    return deferRescan;
+}
 
-            // Update box
-            Contour2f boxCoords;
-            boxCoords.push_back(box.tl());
-            boxCoords.push_back(box.br());
-            Contour2f transformedBoxCoords;
-            cv::transform(boxCoords, transformedBoxCoords, transform);
-            box = Rect(transformedBoxCoords[0], transformedBoxCoords[1]);
+bool RPPG::isWorkerBehind() {
 
-            // Update roi
-            Contour2f roiCoords;
-            roiCoords.push_back(roi.tl());
-            roiCoords.push_back(roi.br());
-            Contour2f transformedRoiCoords;
-            cv::transform(roiCoords, transformedRoiCoords, transform);
-            roi = Rect(transformedRoiCoords[0], transformedRoiCoords[1]);
+    // The estimations have their own deadline: the signal worker should not fall more than a few frame budgets behind
+    const int64_t processed = signals.getProcessedTime();
+    if (frameBudget <= 0 || processed == 0) {
+        return false;
+    }
+    return (time - processed) * settings.timeBase * 1000 > MAX_WORKER_LAG * frameBudget;
+}
 
-            updateMask(frameGray);
-        }
+void RPPG::detectFaces(Mat &frameGray, bool rescan) {
+    
+    LOGD("Scanning for faces…");
+
+    // Tracked motion from this frame on is applied to the boxes found
+    for (size_t i = 0; i < faces.size(); i++) {
+        faces[i]->beginScan();
+    }
+
+    // A single face is rescanned near where it is, several faces in the whole frame, which also finds new ones
+    scanningWholeFrame = !rescan || maxFaces > 1 || faces.size() != 1;
+
+    if (!scanningWholeFrame) {
+
+        // Only near the tracked face and at about its size, stopping at the biggest hit
+        Rect box = faces[0]->getBox();
+        Rect window = Rect(box.x - box.width * RESCAN_PADDING, box.y - box.height * RESCAN_PADDING,
+                           box.width * (1 + 2 * RESCAN_PADDING), box.height * (1 + 2 * RESCAN_PADDING));
+        window &= Rect(0, 0, frameGray.cols, frameGray.rows);
+        detector.submit(frameGray, window, Size(box.width / 2, box.height / 2), Size(box.width * 2, box.height * 2),
+                        true, time);
 
     } else {
 
-        LOGD("Tracking failed! Not enough corners left.");
-        invalidateFace();
+        detector.submit(frameGray, Rect(0, 0, frameGray.cols, frameGray.rows), minFaceSize, Size(),
+                        false, time);
     }
 }
 
-void RPPG::updateROI() {
-    this->roi = Rect(Point(box.tl().x + 0.3 * box.width, box.tl().y + 0.1 * box.height),
-                     Point(box.tl().x + 0.7 * box.width, box.tl().y + 0.25 * box.height));
-}
+void RPPG::updateFaces(Mat &frameGray, vector<Rect> &boxes) {
 
-void RPPG::updateMask(Mat &frameGray) {
-    
-    LOGD("Update mask");
+    double latency, averageLatency;
+    detector.latency(latency, averageLatency);
+    LOGD("Detector %s took %.1fms, %.1fms on average", detector.name(), latency, averageLatency);
 
-    mask = cv::Mat::zeros(frameGray.rows, frameGray.cols, CV_8U);
-    rectangle(mask, this->roi, WHITE, FILLED);
-}
+    if (boxes.empty() && !faces.empty() && !scanningWholeFrame) {
 
-void RPPG::invalidateFace() {
+        LOGD("Face left the rescan window");
 
-    s = Mat1d();
-    s_f = Mat1d();
-    t = Mat1d();
-    re = Mat1b();
-    powerSpectrum = Mat1d();
-    faceValid = false;
-}
+        // Search the whole frame, tracking on meanwhile
+        detectFaces(frameGray, false);
+        return;
+    }
+
+    // Match the boxes to the faces they were searched for, so that tracked faces keep their ids.
+    // A single face is dropped when a whole frame scan misses it, several only after repeated misses.
+    vector<bool> taken(boxes.size(), false);
+    for (size_t i = 0; i < faces.size();) {
+
+        int index = nearestBox(faces[i]->scanBox(), boxes, taken);
+
+        if (index >= 0) {
+
+            // Move the box along with the face since the frame it was found in
+            taken[index] = true;
+            faces[i]->place(frameGray, faces[i]->followMotion(boxes[index]));
+            faces[i]->misses = 0;
+            i++;
 
-void RPPG::extractSignal_g() {
-
-    // Denoise
-    Mat s_den = Mat(s.rows, 1, CV_64F);
-    denoise(s.col(1), re, s_den);
-
-    // Normalise
-    normalization(s_den, s_den);
-
-    // Detrend
-    Mat s_det = Mat(s_den.rows, s_den.cols, CV_64F);
-    detrend(s_den, s_det, fps);
-
-    // Moving average
-    Mat s_mav = Mat(s_det.rows, s_det.cols, CV_64F);
-    movingAverage(s_det, s_mav, 3, fmax(floor(fps/6), 2));
-
-    s_mav.copyTo(s_f);
-
-    // Logging
-    if (logMode) {
-        std::ofstream log;
-        std::ostringstream filepath;
-        filepath << logfilepath << "_signal_" << time << ".csv";
-        log.open(filepath.str().c_str());
-        log << "g;g_den;g_det;g_mav\n";
-        for (int i = 0; i < s.rows; i++) {
-            log << s.at<double>(i, 1) << ";";
-            log << s_den.at<double>(i, 0) << ";";
-            log << s_det.at<double>(i, 0) << ";";
-            log << s_mav.at<double>(i, 0) << "\n";
+        } else if (scanningWholeFrame && (maxFaces == 1 || ++faces[i]->misses > MAX_FACE_MISSES)) {
+
+            LOGD("Found no face %d", faces[i]->getId());
+            removeFace(i);
+
+        } else {
+            i++;
         }
-        log.close();
     }
-}
 
-void RPPG::extractSignal_pca() {
-
-    // Denoise signals
-    Mat s_den = Mat(s.rows, s.cols, CV_64F);
-    denoise(s, re, s_den);
-
-    // Normalize signals
-    normalization(s_den, s_den);
-
-    // Detrend
-    Mat s_det = Mat(s.rows, s.cols, CV_64F);
-    detrend(s_den, s_det, fps);
-
-    // PCA to reduce dimensionality
-    Mat s_pca = Mat(s.rows, 1, CV_32F);
-    Mat pc = Mat(s.rows, s.cols, CV_32F);
-    pcaComponent(s_det, s_pca, pc, low, high);
-
-    // Moving average
-    Mat s_mav = Mat(s.rows, 1, CV_32F);
-    movingAverage(s_pca, s_mav, 3, fmax(floor(fps/6), 2));
-
-    s_mav.copyTo(s_f);
-
-    // Logging
-    if (logMode) {
-        std::ofstream log;
-        std::ostringstream filepath;
-        filepath << logfilepath << "_signal_" << time << ".csv";
-        log.open(filepath.str().c_str());
-        log << "re;r;g;b;r_den;g_den;b_den;r_det;g_det;b_det;pc1;pc2;pc3;s_pca;s_mav\n";
-        for (int i = 0; i < s.rows; i++) {
-            log << re.at<bool>(i, 0) << ";";
-            log << s.at<double>(i, 0) << ";";
-            log << s.at<double>(i, 1) << ";";
-            log << s.at<double>(i, 2) << ";";
-            log << s_den.at<double>(i, 0) << ";";
-            log << s_den.at<double>(i, 1) << ";";
-            log << s_den.at<double>(i, 2) << ";";
-            log << s_det.at<double>(i, 0) << ";";
-            log << s_det.at<double>(i, 1) << ";";
-            log << s_det.at<double>(i, 2) << ";";
-            log << pc.at<double>(i, 0) << ";";
-            log << pc.at<double>(i, 1) << ";";
-            log << pc.at<double>(i, 2) << ";";
-            log << s_pca.at<double>(i, 0) << ";";
-            log << s_mav.at<double>(i, 0) << "\n";
+    // The remaining boxes are new faces, the biggest first
+    vector<Rect> found;
+    for (size_t j = 0; j < boxes.size(); j++) {
+        if (!taken[j]) {
+            found.push_back(boxes[j]);
         }
-        log.close();
     }
-}
+    std::sort(found.begin(), found.end(), isBigger);
 
-void RPPG::extractSignal_xminay() {
-
-    // Denoise signals
-    Mat s_den = Mat(s.rows, s.cols, CV_64F);
-    denoise(s, re, s_den);
-
-    // Normalize raw signals
-    Mat s_n = Mat(s_den.rows, s_den.cols, CV_64F);
-    normalization(s_den, s_n);
-
-    // Calculate X_s signal
-    Mat x_s = Mat(s.rows, s.cols, CV_64F);
-    addWeighted(s_n.col(0), 3, s_n.col(1), -2, 0, x_s);
-
-    // Calculate Y_s signal
-    Mat y_s = Mat(s.rows, s.cols, CV_64F);
-    addWeighted(s_n.col(0), 1.5, s_n.col(1), 1, 0, y_s);
-    addWeighted(y_s, 1, s_n.col(2), -1.5, 0, y_s);
-
-    // Bandpass
-    Mat x_f = Mat(s.rows, s.cols, CV_32F);
-    bandpass(x_s, x_f, low, high);
-    x_f.convertTo(x_f, CV_64F);
-    Mat y_f = Mat(s.rows, s.cols, CV_32F);
-    bandpass(y_s, y_f, low, high);
-    y_f.convertTo(y_f, CV_64F);
-
-    // Calculate alpha
-    Scalar mean_x_f;
-    Scalar stddev_x_f;
-    meanStdDev(x_f, mean_x_f, stddev_x_f);
-    Scalar mean_y_f;
-    Scalar stddev_y_f;
-    meanStdDev(y_f, mean_y_f, stddev_y_f);
-    double alpha = stddev_x_f.val[0]/stddev_y_f.val[0];
-
-    // Calculate signal
-    Mat xminay = Mat(s.rows, 1, CV_64F);
-    addWeighted(x_f, 1, y_f, -alpha, 0, xminay);
-
-    // Moving average
-    movingAverage(xminay, s_f, 3, fmax(floor(fps/6), 2));
-
-    // Logging
-    if (logMode) {
-        std::ofstream log;
-        std::ostringstream filepath;
-        filepath << logfilepath << "_signal_" << time << ".csv";
-        log.open(filepath.str().c_str());
-        log << "r;g;b;r_den;g_den;b_den;x_s;y_s;x_f;y_f;s;s_f\n";
-        for (int i = 0; i < s.rows; i++) {
-            log << s.at<double>(i, 0) << ";";
-            log << s.at<double>(i, 1) << ";";
-            log << s.at<double>(i, 2) << ";";
-            log << s_den.at<double>(i, 0) << ";";
-            log << s_den.at<double>(i, 1) << ";";
-            log << s_den.at<double>(i, 2) << ";";
-            log << x_s.at<double>(i, 0) << ";";
-            log << y_s.at<double>(i, 0) << ";";
-            log << x_f.at<double>(i, 0) << ";";
-            log << y_f.at<double>(i, 0) << ";";
-            log << xminay.at<double>(i, 0) << ";";
-            log << s_f.at<double>(i, 0) << "\n";
-        }
-        log.close();
+    for (size_t j = 0; j < found.size() && (int)faces.size() < maxFaces; j++) {
+
+        LOGD("Found face %d", nextId);
+
+        Ptr<Face> face(new Face(nextId++, settings));
+        face->place(frameGray, found[j]);
+        faces.push_back(face);
     }
 }
 
-void RPPG::estimateHeartrate() {
-
-    powerSpectrum = Mat(s_f.size(), CV_32F);
-    timeToFrequency(s_f, powerSpectrum, true);
-
-    // band mask
-    const int total = s_f.rows;
-    Mat bandMask = Mat::zeros(s_f.size(), CV_8U);
-    bandMask.rowRange(min(low, total), min(high, total) + 1).setTo(ONE);
-
-    if (!powerSpectrum.empty()) {
-
-        // grab index of max power spectrum
-        double min, max;
-        Point pmin, pmax;
-        minMaxLoc(powerSpectrum, &min, &max, &pmin, &pmax, bandMask);
-
-        // calculate BPM
-        bpm = pmax.y * fps / total * SEC_PER_MIN;
-        bpms.push_back(bpm);
-
-        // calculate BPM based on weighted squares power spectrum
-        //double weightedSquares = weightedSquaresMeanIndex(powerSpectrum, low, high);
-        //double bpm_ws = weightedSquares * fps / total * SEC_PER_MIN;
-        //bpms_ws.push_back(bpm_ws);
-
-        LOGD("FPS=%f Vals=%d Peak=%d BPM=%f", fps, powerSpectrum.rows, pmax.y, bpm);
-
-        // Logging
-        if (logMode) {
-            std::ofstream log;
-            std::ostringstream filepath;
-            filepath << logfilepath << "_estimation_" << time << ".csv";
-            log.open(filepath.str().c_str());
-            log << "i;powerSpectrum\n";
-            for (int i = 0; i < powerSpectrum.rows; i++) {
-                if (low <= i && i <= high) {
-                    log << i << ";";
-                    log << powerSpectrum.at<double>(i, 0) << "\n";
-                }
-            }
-            log.close();
+int RPPG::nearestBox(Rect box, const vector<Rect> &boxes, const vector<bool> &taken) {
+    int index = -1;
+    int min = 0;
+    for (int i = 0; i < boxes.size(); i++) {
+        if (taken[i]) {
+            continue;
+        }
+        Point p = box.tl() - boxes.at(i).tl();
+        int d = p.x * p.x + p.y * p.y;
+        if (index < 0 || d < min) {
+            min = d;
+            index = i;
         }
     }
 
-    if ((time - lastSamplingTime) * timeBase >= 1/samplingFrequency) {
-        lastSamplingTime = time;
-
-        cv::sort(bpms, bpms, SORT_EVERY_COLUMN);
+    // With several faces, only a box about where the face was is the same face
+    if (index >= 0 && maxFaces > 1) {
+        Point p = (box.tl() + box.br()) * 0.5 - (boxes[index].tl() + boxes[index].br()) * 0.5;
+        double limit = box.width * MATCH_DISTANCE;
+        if (p.x * p.x + p.y * p.y > limit * limit) {
+            return -1;
+        }
+    }
+    return index;
+}
 
-        // average calculated BPMs since last sampling time
-        meanBpm = mean(bpms)(0);
-        minBpm = bpms.at<double>(0, 0);
-        maxBpm = bpms.at<double>(bpms.rows-1, 0);
+void RPPG::removeFace(size_t i) {
 
-        // cv::sort(bpms_ws, bpms_ws, SORT_EVERY_COLUMN);
-        // meanBpm_ws = mean(bpms_ws)(0);
-        // minBpm_ws = bpms_ws.at<double>(0, 0);
-        // maxBpm_ws = bpms_ws.at<double>(bpms_ws.rows-1, 0);
+    // End the signal of the face
+    FaceSample lost;
+    lost.kind = FaceSample::lost;
+    lost.face = faces[i]->getId();
+    lost.time = time;
+    signals.push(lost);
 
-        callback(time, meanBpm, minBpm, maxBpm);
+    faces.erase(faces.begin() + i);
 
-        bpms.pop_back(bpms.rows);
-        // bpms_ws.pop_back(bpms_ws.rows);
+    // A pending search near the last face is of no use anymore
+    if (faces.empty()) {
+        detector.cancel();
     }
 }
 
-void RPPG::log() {
+void RPPG::onResult(int face, int64_t time, double meanBpm, double minBpm, double maxBpm, bool provisional) {
+    callback(time, face, meanBpm, minBpm, maxBpm, provisional);
+}
 
-    if (lastSamplingTime == time || lastSamplingTime == 0) {
-        logfile << time << ";";
-        logfile << faceValid << ";";
-        logfile << meanBpm << ";";
-        logfile << minBpm << ";";
-        logfile << maxBpm << "\n";
-        logfile.flush();
-    }
+void RPPG::onWorkerExit() {
 
-    logfileDetailed << time << ";";
-    logfileDetailed << faceValid << ";";
-    logfileDetailed << bpm << "\n";
-    logfileDetailed.flush();
+    // Threads attached by the callback have to detach before they end
+    JNIEnv *jenv;
+    if (jvm != NULL && jvm->GetEnv((void **)&jenv, JNI_VERSION_1_6) == JNI_OK) {
+        jvm->DetachCurrentThread();
+    }
 }
 
-void RPPG::callback(int64_t time, double meanBpm, double minBpm, double maxBpm) {
+void RPPG::callback(int64_t time, int face, double meanBpm, double minBpm, double maxBpm, bool provisional) {
+
+    if (listener == NULL) {
+        return;
+    }
 
     JNIEnv *jenv;
     int stat = jvm->GetEnv((void **)&jenv, JNI_VERSION_1_6);
@@ -609,102 +512,14 @@ void RPPG::callback(int64_t time, double meanBpm, double minBpm, double maxBpm)
 
     // Return object
 
-    // Get Return object class reference
-    jclass returnObjectClassRef = jenv->FindClass("com/prouast/heartbeat/RPPGResult");
-
-    // Get Return object constructor method
-    jmethodID constructorMethodID = jenv->GetMethodID(returnObjectClassRef, "<init>", "(JDDD)V");
-
-    // Create Info class
-    jobject returnObject = jenv->NewObject(returnObjectClassRef, constructorMethodID, (jlong)time, meanBpm, minBpm, maxBpm);
+    // Create Info class, with the class and constructor looked up at load time
+    jobject returnObject = jenv->NewObject(resultClass, resultConstructor, (jlong)time, (jint)face, meanBpm, minBpm, maxBpm, (jboolean)provisional);
 
     // Listener
 
-    // Get the Listener class reference
-    jclass listenerClassRef = jenv->GetObjectClass(listener);
-
-    // Use Listener class reference to load the eventOccurred method
-    jmethodID listenerEventOccuredMethodID = jenv->GetMethodID(listenerClassRef, "onRPPGResult", "(Lcom/prouast/heartbeat/RPPGResult;)V");
-
     // Invoke listener eventOccurred
-    jenv->CallVoidMethod(listener, listenerEventOccuredMethodID, returnObject);
+    jenv->CallVoidMethod(listener, listenerMethod, returnObject);
 
     // Cleanup
     jenv->DeleteLocalRef(returnObject);
 }
-
-void RPPG::draw(Mat &frameRGB) {
-
-    // Draw roi
-    rectangle(frameRGB, roi, GREEN);
-
-    // Draw face shape
-    //ellipse(frameRGB,
-    //        Point(box.tl().x + box.width / 2.0, box.tl().y + box.height / 2.0),
-    //        Size(box.width / 2.5, box.height / 2.0),
-    //        0, 0, 360, GREEN);
-
-    // Draw bounding box
-    rectangle(frameRGB, box, RED);
-
-    // Draw signal
-    if (!s_f.empty() && !powerSpectrum.empty()) {
-
-        // Display of signals with fixed dimensions
-        double displayHeight = box.height/2.0;
-        double displayWidth = box.width*0.8;
-
-        // Draw signal
-        double vmin, vmax;
-        Point pmin, pmax;
-        minMaxLoc(s_f, &vmin, &vmax, &pmin, &pmax);
-        double heightMult = displayHeight/(vmax - vmin);
-        double widthMult = displayWidth/(s_f.rows - 1);
-        double drawAreaTlX = box.tl().x + box.width + 20;
-        double drawAreaTlY = box.tl().y;
-        Point p1(drawAreaTlX, drawAreaTlY + (vmax - s_f.at<double>(0, 0))*heightMult);
-        Point p2;
-        for (int i = 1; i < s_f.rows; i++) {
-            p2 = Point(drawAreaTlX + i * widthMult, drawAreaTlY + (vmax - s_f.at<double>(i, 0))*heightMult);
-            line(frameRGB, p1, p2, RED, 2);
-            p1 = p2;
-        }
-
-        // Draw powerSpectrum
-        const int total = s_f.rows;
-        Mat bandMask = Mat::zeros(s_f.size(), CV_8U);
-        bandMask.rowRange(min(low, total), min(high, total) + 1).setTo(ONE);
-        minMaxLoc(powerSpectrum, &vmin, &vmax, &pmin, &pmax, bandMask);
-        heightMult = displayHeight/(vmax - vmin);
-        widthMult = displayWidth/(high - low);
-        drawAreaTlX = box.tl().x + box.width + 20;
-        drawAreaTlY = box.tl().y + box.height/2.0;
-        p1 = Point(drawAreaTlX, drawAreaTlY + (vmax - powerSpectrum.at<double>(low, 0))*heightMult);
-        for (int i = low + 1; i <= high; i++) {
-            p2 = Point(drawAreaTlX + (i - low) * widthMult, drawAreaTlY + (vmax - powerSpectrum.at<double>(i, 0)) * heightMult);
-            line(frameRGB, p1, p2, RED, 2);
-            p1 = p2;
-        }
-    }
-
-    std::stringstream ss;
-
-    // Draw BPM text
-    if (faceValid) {
-        ss.precision(3);
-        ss << meanBpm << " bpm";
-        putText(frameRGB, ss.str(), Point(box.tl().x, box.tl().y - 10), FONT_HERSHEY_PLAIN, 2, RED, 2);
-    }
-
-    // Draw FPS text
-    ss.str("");
-    ss << fps << " fps";
-    putText(frameRGB, ss.str(), Point(box.tl().x, box.br().y + 40), FONT_HERSHEY_PLAIN, 2, GREEN, 2);
-
-    // Draw corners
-    for (int i = 0; i < corners.size(); i++) {
-        //circle(frameRGB, corners[i], r, WHITE, -1, 8, 0);
-        line(frameRGB, Point(corners[i].x-5,corners[i].y), Point(corners[i].x+5,corners[i].y), GREEN, 1);
-        line(frameRGB, Point(corners[i].x,corners[i].y-5), Point(corners[i].x,corners[i].y+5), GREEN, 1);
-    }
-}
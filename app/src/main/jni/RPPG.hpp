@@ -15,116 +15,134 @@
 #include <stdio.h>
 #include <jni.h>
 
+#include "opencv.hpp"
+#include "DetectionWorker.hpp"
+#include "Face.hpp"
+#include "SignalWorker.hpp"
+
 using namespace cv;
 using namespace std;
 
-enum RPPGAlgorithm { g, pca, xminay };
+// Counters of the frame budget since loading
+struct RPPGCounters {
+    RPPGCounters() : frames(0), deadlineMisses(0), skippedDrawings(0), deferredEstimations(0), deferredRescans(0) {;}
+    int64_t frames;
+    int64_t deadlineMisses;
+    int64_t skippedDrawings;
+    int64_t deferredEstimations;
+    int64_t deferredRescans;
+};
 
-class RPPG {
+// Time spent in the stages since loading, in milliseconds
+struct RPPGTimings {
+    RPPGTimings() : frames(0), pyramid(0), tracking(0), scanning(0), sampling(0), drawing(0), signalFrames(0), signal(0) {;}
+    int64_t frames;
+    double pyramid;
+    double tracking;
+    double scanning;
+    double sampling;
+    double drawing;
+    int64_t signalFrames;                                                       // Frames the signal worker finished
+    double signal;
+};
+
+class RPPG : public SignalListener {
     
 public:
     
     // Constructor
-    RPPG() {;}
+    RPPG() : jvm(NULL), listener(NULL), resultClass(NULL) {;}
     
-    // Load Settings
+    // Load Settings, without a Java callback if listener is NULL
     bool load(jobject listener, JNIEnv *jenv,                                   // Listener and environment for Java callback
-              int algorithm,
+              int algorithm, int detectorType, const int maxFaces,
               const int width, const int height, const double timeBase, const int downsample,
-              const double samplingFrequency, const double rescanFrequency,
-              const int minSignalSize, const int maxSignalSize,
+              const double samplingFrequency, const double rescanFrequency, const double frameBudget,
+              const int estimationHopSamples, const int estimationHopMillis,
+              const double progressiveSignalSize, const int minSignalSize, const int maxSignalSize,
               const string &logPath, const string &classifierPath,
               const bool log, const bool gui);
     
     void processFrame(Mat &frameRGB, Mat &frameGray, int64_t time);
     
     void exit(JNIEnv *jenv);
-    
-    typedef vector<Point2f> Contour2f;
+
+    // Camera thread, between frames
+    RPPGCounters getCounters() const;
+    RPPGTimings getTimings() const;
+
+    // Camera thread: wait until the signal worker finished every frame so far
+    void flush();
     
 private:
+
+    // Steps of shedding camera thread work when a frame would overrun its budget, each including the ones before
+    enum Degradation { fullFrame, skipDrawing, deferRescan };
     
-    void detectFace(Mat &frameRGB, Mat &frameGray);
-    void setNearestBox(vector<Rect> boxes);
-    void detectCorners(Mat &frameGray);
-    void trackFace(Mat &frameGray);
-    void updateMask(Mat &frameGray);
-    void updateROI();
-    void extractSignal_g();
-    void extractSignal_pca();
-    void extractSignal_xminay();
-    void estimateHeartrate();
-    void draw(Mat &frameRGB);
-    void invalidateFace();
-    void log();
-
-    void callback(int64_t now, double meanBpm, double minBpm, double maxBpm);   // Callback to Java
+    void detectFaces(Mat &frameGray, bool rescan);
+    void updateFaces(Mat &frameGray, vector<Rect> &boxes);
+    bool isRescanDue();
+    Degradation degrade(double elapsed, bool rescanDue);
+    bool isWorkerBehind();
+    int nearestBox(Rect box, const vector<Rect> &boxes, const vector<bool> &taken);
+    void removeFace(size_t i);
+
+    // Results of the signal worker, on its thread
+    void onResult(int face, int64_t time, double meanBpm, double minBpm, double maxBpm, bool provisional);
+    void onWorkerExit();
+
+    void callback(int64_t now, int face, double meanBpm, double minBpm, double maxBpm, bool provisional);   // Callback to Java
 
     // The JavaVM
     JavaVM *jvm;
 
     // The listener
     jobject listener;
+    jmethodID listenerMethod;
 
-    // The algorithm
-    RPPGAlgorithm algorithm;
+    // The result class
+    jclass resultClass;
+    jmethodID resultConstructor;
 
-    // The classifiers
-    CascadeClassifier classifier;
+    // The classifiers, run on a worker thread
+    DetectionWorker detector;
 
     // Settings
+    RPPGSettings settings;
     Size minFaceSize;
-    int maxSignalSize;
-    int minSignalSize;
-    double rescanFrequency;
-    double samplingFrequency;
-    double timeBase;
-    bool logMode;
-    bool guiMode;
+    int maxFaces;
+    double rescanFrequency;                                                     // Rescans at least this often, sooner if tracking becomes doubtful
 
     // State variables
     int64_t time;
-    double fps;
-    int high;
-    int64_t lastSamplingTime;
     int64_t lastScanTime;
-    int low;
-    int64_t now;
-    bool faceValid;
-    bool rescanFlag;
-    
+
+    // Detection
+    bool scanningWholeFrame;
+
+    // Frame budget in milliseconds, 0 if unlimited, with moving estimates of the cost of the stages
+    double frameBudget;
+    double samplingCost;
+    double drawingCost;
+    double rescanCost;
+    int rescanDeferrals;
+    RPPGCounters counters;
+    RPPGTimings timings;
+
+    // Downsampled frames
+    Mat processingGray;
+    Mat processingRGB;
+
     // Tracking
-    Mat lastFrameGray;
-    Contour2f corners;
-
-    // Mask
-    Rect box;
-    Mat1b mask;
-    Rect roi;
-
-    // Raw signal
-    Mat1d s;
-    Mat1d t;
-    Mat1b re;
-
-    // Estimation
-    Mat1d s_f;
-    Mat1d bpms;
-    //Mat1d bpms_ws;
-    Mat1d powerSpectrum;
-    double bpm = 0.0;
-    //double bpm_ws = 0.0;
-    double meanBpm;
-    double minBpm;
-    double maxBpm;
-    //double meanBpm_ws;
-    //double minBpm_ws;
-    //double maxBpm_ws;
-    
-    // Logfiles
-    ofstream logfile;
-    ofstream logfileDetailed;
-    string logfilepath;
+    vector<Mat> pyramid;
+    vector<Mat> lastPyramid;
+
+    // The tracked faces and the id of the next new face
+    vector<Ptr<Face> > faces;
+    int nextId;
+
+    // The signals of the faces, processed on a worker thread
+    SignalWorker signals;
 };
 
 #endif /* RPPG_hpp */
@@ -0,0 +1,87 @@
+//
+//  RoiSampler.cpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#include "RoiSampler.hpp"
+
+#include <algorithm>
+
+#include "simd.hpp"
+
+using namespace cv;
+using namespace std;
+
+void RoiSampler::add(const string &name, Rect2d relative) {
+    CV_Assert(regions.size() < MAX_REGIONS);
+    Region region;
+    region.name = name;
+    region.relative = relative;
+    std::fill(region.last, region.last + 4, 0.0);
+    regions.push_back(region);
+}
+
+void RoiSampler::gate(int crLow, int crHigh, int cbLow, int cbHigh, double minSkin) {
+    this->gated = true;
+    this->cr[0] = crLow;
+    this->cr[1] = crHigh;
+    this->cb[0] = cbLow;
+    this->cb[1] = cbHigh;
+    this->minSkin = minSkin;
+}
+
+void RoiSampler::place(Rect box) {
+    for (size_t i = 0; i < regions.size(); i++) {
+        const Rect2d &r = regions[i].relative;
+        regions[i].rect = Rect(Point(box.x + r.x * box.width, box.y + r.y * box.height),
+                               Point(box.x + (r.x + r.width) * box.width, box.y + (r.y + r.height) * box.height));
+    }
+}
+
+void RoiSampler::transform(const Mat &transform) {
+    for (size_t i = 0; i < regions.size(); i++) {
+        vector<Point2f> coords;
+        coords.push_back(regions[i].rect.tl());
+        coords.push_back(regions[i].rect.br());
+        vector<Point2f> transformedCoords;
+        cv::transform(coords, transformedCoords, transform);
+        regions[i].rect = Rect(transformedCoords[0], transformedCoords[1]);
+    }
+}
+
+void RoiSampler::sample(const Mat &frame) {
+    const Rect bounds(0, 0, frame.cols, frame.rows);
+    for (size_t i = 0; i < regions.size(); i++) {
+        Region &region = regions[i];
+
+        // Only the part inside the frame, holding the last means if there is none
+        const Rect r = region.rect & bounds;
+        if (r.area() > 0) {
+            if (!gated || frame.type() != CV_8UC4 || !skinMeans(frame(r), region.last)) {
+                Scalar means = mean(frame(r));
+                for (int c = 0; c < 4; c++) {
+                    region.last[c] = means(c);
+                }
+            }
+        }
+    }
+}
+
+bool RoiSampler::skinMeans(const Mat &patch, double means[3]) const {
+
+    // Row by row, as the patch is a sub-matrix
+    unsigned int sums[4] = {0, 0, 0, 0};
+    for (int y = 0; y < patch.rows; y++) {
+        sumSkinPixels(patch.ptr<uchar>(y), patch.cols, cr, cb, sums);
+    }
+
+    if (sums[3] == 0 || sums[3] < minSkin * patch.total()) {
+        return false;
+    }
+    for (int c = 0; c < 3; c++) {
+        means[c] = (double)sums[c] / sums[3];
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+//
+//  RoiSampler.hpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#ifndef RoiSampler_hpp
+#define RoiSampler_hpp
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// Named regions of interest placed relative to the face box, each with the means of its last sample.
+// Regions are averaged by reducing their sub-matrix only, so sampling costs scale with the
+// area of the regions and not with the frame size. The first region is the primary one.
+// Optionally, only skin coloured pixels of an RGBA frame are averaged, gated in the same pass.
+class RoiSampler {
+
+public:
+
+    enum { MAX_REGIONS = 4 };
+
+    RoiSampler() : gated(false), minSkin(0) {;}
+
+    // Average only pixels within the 8 bit YCrCb ranges, or all pixels if less than the fraction minSkin of a region passes
+    void gate(int crLow, int crHigh, int cbLow, int cbHigh, double minSkin);
+
+    // Add a region as fractions of the face box, at most MAX_REGIONS
+    void add(const std::string &name, cv::Rect2d relative);
+
+    // Place the regions in the face box
+    void place(cv::Rect box);
+
+    // Move the regions along with the face by a 2x3 transform
+    void transform(const cv::Mat &transform);
+
+    // Update the means of the regions in the frame
+    void sample(const cv::Mat &frame);
+
+    int count() const { return (int)regions.size(); }
+    const std::string &name(int i) const { return regions[i].name; }
+    cv::Rect rect(int i) const { return regions[i].rect; }
+    const double *means(int i) const { return regions[i].last; }
+
+private:
+
+    struct Region {
+        std::string name;
+        cv::Rect2d relative;
+        cv::Rect rect;
+        double last[4];
+    };
+
+    bool skinMeans(const cv::Mat &patch, double means[3]) const;
+
+    std::vector<Region> regions;
+
+    // Skin gate
+    bool gated;
+    int cr[2];
+    int cb[2];
+    double minSkin;
+};
+
+#endif /* RoiSampler_hpp */
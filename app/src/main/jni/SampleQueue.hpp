@@ -0,0 +1,76 @@
+//
+//  SampleQueue.hpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#ifndef SampleQueue_hpp
+#define SampleQueue_hpp
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+// Bounded lock-free queue between exactly one producer and one consumer thread.
+// Only the producer writes the tail and only the consumer the head. Each publishes its index
+// with release ordering after touching the slot, the other side reads it with acquire ordering.
+// One slot always stays free to tell a full queue from an empty one.
+template <typename T>
+class SampleQueue {
+
+public:
+
+    SampleQueue() : mask(0), head(0), tail(0) {;}
+
+    // Room for at least capacity items, before either thread uses the queue
+    void allocate(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity + 1) {
+            size <<= 1;
+        }
+        ring.assign(size, T());
+        mask = size - 1;
+        head.store(0);
+        tail.store(0);
+    }
+
+    // Producer: false if the queue is full
+    bool push(const T &item) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        const size_t next = (t + 1) & mask;
+        if (next == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        ring[t] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: false if the queue is empty
+    bool pop(T &item) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = ring[h];
+        head.store((h + 1) & mask, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+
+    std::vector<T> ring;
+    size_t mask;
+
+    // On separate cache lines, so that the threads don't invalidate each other's index
+    std::atomic<size_t> head;
+    char padding[64];
+    std::atomic<size_t> tail;
+};
+
+#endif /* SampleQueue_hpp */
@@ -0,0 +1,74 @@
+//
+//  SignalBuffer.cpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#include "SignalBuffer.hpp"
+
+#include <limits>
+
+using namespace cv;
+using namespace std;
+
+void SignalBuffer::allocate(int capacity, int channels) {
+    this->capacity = capacity;
+    this->channels = channels;
+    valueData.assign(channels * 2 * capacity, 0);
+    timeData.assign(2 * capacity, 0);
+    rescanData.assign(2 * capacity, 0);
+    clear();
+}
+
+void SignalBuffer::clear() {
+    first = 0;
+    length = 0;
+}
+
+void SignalBuffer::push(const double *values, int64_t time, bool rescan) {
+
+    CV_Assert(length < capacity);
+
+    // Write to both copies of the slot
+    int i = (first + length) % capacity;
+    for (int c = 0; c < channels; c++) {
+        valueData[c * 2 * capacity + i] = values[c];
+        valueData[c * 2 * capacity + i + capacity] = values[c];
+    }
+    timeData[i] = timeData[i + capacity] = time;
+    rescanData[i] = rescanData[i + capacity] = rescan;
+
+    length++;
+}
+
+void SignalBuffer::pop() {
+    if (length > 0) {
+        first = (first + 1) % capacity;
+        length--;
+    }
+}
+
+Mat SignalBuffer::channel(int c) {
+    return Mat(length, 1, SAMPLE_TYPE, &valueData[c * 2 * capacity + first]);
+}
+
+Mat SignalBuffer::rescan() {
+    return Mat(length, 1, CV_8U, &rescanData[first]);
+}
+
+double SignalBuffer::getFps(const double timeBase) const {
+
+    double result;
+
+    if (length == 0) {
+        result = 1.0;
+    } else if (length == 1) {
+        result = std::numeric_limits<double>::max();
+    } else {
+        double diff = (time(length-1) - time(0)) * timeBase;
+        result = diff == 0 ? std::numeric_limits<double>::max() : length/diff;
+    }
+
+    return result;
+}
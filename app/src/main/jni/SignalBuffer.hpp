@@ -0,0 +1,66 @@
+//
+//  SignalBuffer.hpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#ifndef SignalBuffer_hpp
+#define SignalBuffer_hpp
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "simd.hpp"
+
+// Fixed capacity ring buffer for the raw signal.
+// Channels, timestamps and rescan flags are stored as separate arrays. Every sample is
+// written twice, capacity apart, so that the current window is always contiguous and can
+// be handed out as a Mat header without copying.
+class SignalBuffer {
+
+public:
+
+    SignalBuffer() : capacity(0), channels(0), first(0), length(0) {;}
+
+    // Allocate storage, called once at load time
+    void allocate(int capacity, int channels);
+
+    // Remove all samples
+    void clear();
+
+    // Append a sample, the buffer must not be full. Values are stored at the precision of the signal path.
+    void push(const double *values, int64_t time, bool rescan);
+
+    // Remove the oldest sample
+    void pop();
+
+    int size() const { return length; }
+    bool empty() const { return length == 0; }
+    bool full() const { return length == capacity; }
+
+    // Zero-copy views of the current window, valid until the next push or pop
+    cv::Mat channel(int c);
+    cv::Mat rescan();
+    const int64_t *times() const { return &timeData[first]; }
+
+    cv::Sample value(int i, int c) const { return valueData[c * 2 * capacity + first + i]; }
+    int64_t time(int i) const { return timeData[first + i]; }
+
+    // Sampling rate of the current window
+    double getFps(const double timeBase) const;
+
+private:
+
+    int capacity;
+    int channels;
+    int first;
+    int length;
+
+    std::vector<cv::Sample> valueData;
+    std::vector<int64_t> timeData;
+    std::vector<unsigned char> rescanData;
+};
+
+#endif /* SignalBuffer_hpp */
@@ -0,0 +1,658 @@
+//
+//  SignalPipeline.cpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#include "SignalPipeline.hpp"
+
+#include <cmath>
+
+using namespace cv;
+using namespace std;
+
+#define INCREMENTAL_DETREND 1
+#define OVERLAP_ADD_WINDOW 1.6
+
+/* STAGES */
+
+void DenoiseStage::reset() {
+    filter.reset();
+}
+
+bool DenoiseStage::update(const Mat *channels, int count, const Mat &re, int dropped) {
+    return filter.apply(channels, count, re, out, dropped);
+}
+
+void NormalizeStage::reset() {
+    rows = 0;
+    cols = 0;
+    first = 0;
+    updates = 0;
+    normalised = false;
+    window.clear();
+    means.clear();
+    m2.clear();
+}
+
+void NormalizeStage::add(const Sample *row) {
+    const int n = rows + 1;
+    for (int c = 0; c < cols; c++) {
+        const double delta = row[c] - means[c];
+        means[c] += delta / n;
+        m2[c] += delta * (row[c] - means[c]);
+    }
+    rows = n;
+}
+
+void NormalizeStage::remove(const Sample *row) {
+    const int n = rows - 1;
+    for (int c = 0; c < cols; c++) {
+        if (n == 0) {
+            means[c] = 0;
+            m2[c] = 0;
+        } else {
+            const double delta = row[c] - means[c];
+            means[c] -= delta / n;
+            m2[c] -= delta * (row[c] - means[c]);
+        }
+    }
+    rows = n;
+}
+
+void NormalizeStage::update(const Mat &s, int dropped, bool restart) {
+
+    CV_Assert(s.type() == SAMPLE_TYPE);
+
+    const int kept = rows - dropped;
+
+    // Recalculate once per window length, so that rounding in the removals does not accumulate
+    if (restart || s.cols != cols || kept < 0 || kept > s.rows || updates >= s.rows) {
+
+        cols = s.cols;
+        rows = 0;
+        first = 0;
+        updates = 0;
+        means.assign(cols, 0);
+        m2.assign(cols, 0);
+        window.resize(s.rows * cols);
+        for (int i = 0; i < s.rows; i++) {
+            std::copy(s.ptr<Sample>(i), s.ptr<Sample>(i) + cols, &window[i * cols]);
+            add(&window[i * cols]);
+        }
+
+    } else {
+
+        for (int i = 0; i < dropped; i++) {
+            remove(&window[(first + i) * cols]);
+        }
+
+        // Compact once the discarded prefix outgrows the window
+        first += dropped;
+        if (first > s.rows) {
+            window.erase(window.begin(), window.begin() + first * cols);
+            first = 0;
+        }
+
+        for (int i = kept; i < s.rows; i++) {
+            window.insert(window.end(), s.ptr<Sample>(i), s.ptr<Sample>(i) + cols);
+            add(&window[window.size() - cols]);
+        }
+        updates++;
+    }
+
+    normalised = false;
+}
+
+double NormalizeStage::stdDev(int c) const {
+    return rows > 0 ? std::sqrt(std::max(m2[c] / rows, 0.0)) : 0;
+}
+
+const Mat &NormalizeStage::output() {
+    if (!normalised) {
+        offsets.resize(SAMPLE_PATTERN_ROWS * cols);
+        scales.resize(SAMPLE_PATTERN_ROWS * cols);
+        for (int c = 0; c < cols; c++) {
+            offsets[c] = means[c];
+            scales[c] = 1 / stdDev(c);
+        }
+        repeatColumns(&offsets[0], cols);
+        repeatColumns(&scales[0], cols);
+        out.create(rows, cols, SAMPLE_TYPE);
+        normaliseSamples(&window[first * cols], out.ptr<Sample>(0), rows, cols, &offsets[0], &scales[0]);
+        normalised = true;
+    }
+    return out;
+}
+
+void DetrendStage::reset() {
+    filter.reset();
+}
+
+void DetrendStage::update(const Mat &s, const NormalizeStage &normalize, int lambda, int dropped) {
+
+    // Detrending is linear and removes constants, so the stateful filter works on the
+    // unnormalised signal, whose overlap with the last frame is unchanged, and is scaled after
+#if INCREMENTAL_DETREND
+    filter.apply(s, detrended, lambda, dropped);
+#else
+    batch.apply(s, detrended, lambda);
+#endif
+    zeros.resize(SAMPLE_PATTERN_ROWS * detrended.cols, 0);
+    scales.resize(SAMPLE_PATTERN_ROWS * detrended.cols);
+    for (int c = 0; c < detrended.cols; c++) {
+        scales[c] = 1 / normalize.stdDev(c);
+    }
+    repeatColumns(&scales[0], detrended.cols);
+    out.create(detrended.rows, detrended.cols, SAMPLE_TYPE);
+    normaliseSamples(detrended.ptr<Sample>(0), out.ptr<Sample>(0), out.rows, out.cols, &zeros[0], &scales[0]);
+}
+
+void PcaStage::reset() {
+    rows = 0;
+    first = 0;
+    updates = 0;
+    selected = 0;
+    oriented = false;
+    std::fill(&vectors[0][0], &vectors[0][0] + 9, 0.0);
+    window.clear();
+}
+
+void PcaStage::accumulate(const Sample *row, double weight) {
+    const double x = row[0], y = row[1], z = row[2];
+    sums[0] += weight * x;
+    sums[1] += weight * y;
+    sums[2] += weight * z;
+    products[0] += weight * x * x;
+    products[1] += weight * x * y;
+    products[2] += weight * x * z;
+    products[3] += weight * y * y;
+    products[4] += weight * y * z;
+    products[5] += weight * z * z;
+}
+
+void PcaStage::update(const DetrendStage &detrend, int dropped, int low, int high) {
+
+    const Mat &u = detrend.unscaled();
+    const Mat &s = detrend.output();
+    CV_Assert(u.cols == 3 && u.type() == SAMPLE_TYPE);
+
+    const int kept = rows - dropped;
+
+    // Recalculate once per window length, so that rounding in the removals does not accumulate
+    if (rows == 0 || kept < 0 || kept > u.rows || updates >= u.rows) {
+
+        first = 0;
+        updates = 0;
+        std::fill(sums, sums + 3, 0.0);
+        std::fill(products, products + 6, 0.0);
+        window.resize(u.rows * 3);
+        for (int i = 0; i < u.rows; i++) {
+            std::copy(u.ptr<Sample>(i), u.ptr<Sample>(i) + 3, &window[i * 3]);
+            accumulate(&window[i * 3], 1);
+        }
+
+    } else {
+
+        for (int i = 0; i < dropped; i++) {
+            accumulate(&window[(first + i) * 3], -1);
+        }
+
+        // Compact once the discarded prefix outgrows the window
+        first += dropped;
+        if (first > u.rows) {
+            window.erase(window.begin(), window.begin() + first * 3);
+            first = 0;
+        }
+
+        // Rows the detrend moved, typically only near the ends
+        for (int i = 0; i < kept; i++) {
+            const Sample *ui = u.ptr<Sample>(i);
+            Sample *wi = &window[(first + i) * 3];
+            if (ui[0] != wi[0] || ui[1] != wi[1] || ui[2] != wi[2]) {
+                accumulate(wi, -1);
+                std::copy(ui, ui + 3, wi);
+                accumulate(wi, 1);
+            }
+        }
+
+        for (int i = kept; i < u.rows; i++) {
+            window.insert(window.end(), u.ptr<Sample>(i), u.ptr<Sample>(i) + 3);
+            accumulate(&window[window.size() - 3], 1);
+        }
+        updates++;
+    }
+
+    rows = u.rows;
+    input = s;
+
+    if (rows < 2) {
+        s.col(0).copyTo(out);
+        return;
+    }
+
+    // Covariance of the scaled signal
+    double k[3];
+    for (int c = 0; c < 3; c++) {
+        k[c] = detrend.scale(c);
+    }
+    const int index[3][3] = {{0, 1, 2}, {1, 3, 4}, {2, 4, 5}};
+    double covariance[6];
+    int n = 0;
+    for (int c = 0; c < 3; c++) {
+        for (int d = c; d < 3; d++) {
+            const double centred = products[index[c][d]] / rows - (sums[c] / rows) * (sums[d] / rows);
+            covariance[n++] = centred * k[c] * k[d];
+        }
+    }
+
+    // Keep the orientation of each eigenvector from frame to frame, on the first update along its largest element
+    double previous[3][3];
+    std::copy(&vectors[0][0], &vectors[0][0] + 9, &previous[0][0]);
+    double values[3];
+    eigenSymmetric3(covariance, values, vectors);
+    for (int i = 0; i < 3; i++) {
+        double d = 0;
+        int largest = 0;
+        for (int j = 0; j < 3; j++) {
+            if (oriented) d += vectors[i][j] * previous[i][j];
+            if (std::abs(vectors[i][j]) > std::abs(vectors[i][largest])) largest = j;
+        }
+        if (oriented ? d < 0 : vectors[i][largest] < 0) {
+            for (int j = 0; j < 3; j++) {
+                vectors[i][j] = -vectors[i][j];
+            }
+        }
+    }
+    oriented = true;
+
+    select(s, low, high);
+
+    // Project on the selected component
+    Sample weights[3];
+    for (int c = 0; c < 3; c++) {
+        weights[c] = vectors[selected][c];
+    }
+    out.create(rows, 1, SAMPLE_TYPE);
+    projectSamples(s.ptr<Sample>(0), out.ptr<Sample>(0), rows, 3, weights);
+}
+
+// Choose the component whose in-band magnitudes, normalised to sum to one, have the highest peak
+void PcaStage::select(const Mat &s, int low, int high) {
+
+    // One pass over the channels as rows
+    planes.create(3, rows, SAMPLE_TYPE);
+    for (int c = 0; c < 3; c++) {
+        Sample *p = planes.ptr<Sample>(c);
+        for (int i = 0; i < rows; i++) {
+            p[i] = s.at<Sample>(i, c);
+        }
+    }
+    dft(planes, spectra, DFT_ROWS);
+
+    // Bins [low, high] of the packed spectra Re0, Re1, Im1, ..., combined per component
+    const int total = rows / 2 + 1;
+    const int from = std::min(low, total);
+    const int to = std::min(high + 1, total);
+    double best = -1;
+    for (int k = 0; k < 3; k++) {
+        double sum = 0, max = 0;
+        for (int b = from; b < to; b++) {
+            double re = 0, im = 0;
+            for (int c = 0; c < 3; c++) {
+                const Sample *X = spectra.ptr<Sample>(c);
+                if (b == 0) {
+                    re += vectors[k][c] * X[0];
+                } else if (2 * b == rows) {
+                    re += vectors[k][c] * X[rows - 1];
+                } else {
+                    re += vectors[k][c] * X[2 * b - 1];
+                    im += vectors[k][c] * X[2 * b];
+                }
+            }
+            const double magnitude = std::sqrt(re * re + im * im);
+            sum += magnitude;
+            max = std::max(max, magnitude);
+        }
+        const double distinct = sum > 0 ? max / sum : 0;
+        if (distinct > best) {
+            best = distinct;
+            selected = k;
+        }
+    }
+}
+
+const Mat &PcaStage::components() {
+    pc.create(input.rows, 3, SAMPLE_TYPE);
+    for (int i = 0; i < input.rows; i++) {
+        const Sample *x = input.ptr<Sample>(i);
+        for (int k = 0; k < 3; k++) {
+            pc.at<Sample>(i, k) = vectors[k][0] * x[0] + vectors[k][1] * x[1] + vectors[k][2] * x[2];
+        }
+    }
+    return pc;
+}
+
+OverlapAddStage::OverlapAddStage(const double first[3], const double second[3]) {
+    std::copy(first, first + 3, projection[0]);
+    std::copy(second, second + 3, projection[1]);
+    reset();
+}
+
+void OverlapAddStage::reset() {
+    length = 0;
+    start = 0;
+    windows.clear();
+}
+
+void OverlapAddStage::addWindow(const Mat &s, int from) {
+
+    // Channel means and covariance of the window
+    double sums[3] = {0, 0, 0};
+    double products[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+    for (int i = from; i < from + length; i++) {
+        const Sample *x = s.ptr<Sample>(i);
+        for (int c = 0; c < 3; c++) {
+            sums[c] += x[c];
+            for (int d = c; d < 3; d++) {
+                products[c][d] += x[c] * x[d];
+            }
+        }
+    }
+    double mean[3];
+    for (int c = 0; c < 3; c++) {
+        mean[c] = sums[c] / length;
+    }
+
+    // Projections of the temporally normalised channels and their variances
+    double p[2][3];
+    double variance[2] = {0, 0};
+    bool valid = mean[0] > 0 && mean[1] > 0 && mean[2] > 0;
+    for (int k = 0; k < 2 && valid; k++) {
+        for (int c = 0; c < 3; c++) {
+            p[k][c] = projection[k][c] / mean[c];
+        }
+        for (int c = 0; c < 3; c++) {
+            for (int d = c; d < 3; d++) {
+                const double covariance = products[c][d] / length - mean[c] * mean[d];
+                variance[k] += (c == d ? 1 : 2) * p[k][c] * p[k][d] * covariance;
+            }
+        }
+    }
+    valid = valid && variance[0] > 0 && variance[1] > 0;
+
+    // h = w * C - offset, where the offset is the mean of w * C
+    const double alpha = valid ? sqrt(variance[0] / variance[1]) : 0;
+    double offset = 0;
+    for (int c = 0; c < 3; c++) {
+        const double w = valid ? p[0][c] + alpha * p[1][c] : 0;
+        windows.push_back(w);
+        offset += w * mean[c];
+    }
+    windows.push_back(offset);
+}
+
+void OverlapAddStage::update(const Mat &s, int dropped, double fps, bool restart) {
+
+    CV_Assert(s.cols == 3 && s.type() == SAMPLE_TYPE);
+
+    // Window length, fixed until it is more than a quarter off
+    const int target = std::min(std::max(cvRound(OVERLAP_ADD_WINDOW * fps), 2), s.rows);
+    const int count = (int)windows.size() / 4;
+    start -= dropped;
+    if (restart || length == 0 || abs(target - length) * 4 > length || start + count < 0) {
+        length = target;
+        start = 0;
+        windows.clear();
+    }
+
+    // Forget windows that no longer overlap the signal
+    const int expired = std::min(std::max(-start - length + 1, 0), (int)windows.size() / 4);
+    windows.erase(windows.begin(), windows.begin() + expired * 4);
+    start += expired;
+
+    // Add the windows that ended in new rows
+    for (int from = start + (int)windows.size() / 4; from + length <= s.rows; from++) {
+        addWindow(s, from);
+    }
+
+    // Each row gets the sum of the windows it is part of
+    out.create(s.rows, 1, SAMPLE_TYPE);
+    const int n = (int)windows.size() / 4;
+    double w[4] = {0, 0, 0, 0};
+    int next = 0;
+    int last = 0;
+    for (int i = 0; i < s.rows; i++) {
+        while (next < n && start + next <= i) {
+            for (int j = 0; j < 4; j++) w[j] += windows[next * 4 + j];
+            next++;
+        }
+        while (last < next && start + last + length <= i) {
+            for (int j = 0; j < 4; j++) w[j] -= windows[last * 4 + j];
+            last++;
+        }
+        const Sample *x = s.ptr<Sample>(i);
+        out.at<Sample>(i, 0) = (Sample)(w[0] * x[0] + w[1] * x[1] + w[2] * x[2] - w[3]);
+    }
+}
+
+void BandpassStage::update(const Mat &s, double low, double high) {
+    engine.bandpass(s, out, low, high);
+}
+
+void SmoothStage::update(const Mat &s, double fps) {
+    int64 start = getTickCount();
+    movingAverage(s, out, 3, fmax(floor(fps/6), 2), scratch);
+    duration = (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
+
+/* PIPELINES */
+
+Ptr<SignalPipeline> SignalPipeline::create(RPPGAlgorithm algorithm) {
+
+    // Plane orthogonal to skin, and chrominance X - αY with the signs of Y flipped
+    static const double posProjection[2][3] = {{0, 1, -1}, {-2, 1, 1}};
+    static const double chromProjection[2][3] = {{3, -2, 0}, {-1.5, -1, 1.5}};
+
+    switch (algorithm) {
+        case pca:
+            return Ptr<SignalPipeline>(new PcaPipeline());
+        case xminay:
+            return Ptr<SignalPipeline>(new XminayPipeline());
+        case pos:
+            return Ptr<SignalPipeline>(new OverlapAddPipeline(posProjection[0], posProjection[1]));
+        case chrom:
+            return Ptr<SignalPipeline>(new OverlapAddPipeline(chromProjection[0], chromProjection[1]));
+        case g:
+        default:
+            return Ptr<SignalPipeline>(new GreenPipeline());
+    }
+}
+
+void SignalPipeline::viewChannels(SignalBuffer &signal) {
+    for (int c = 0; c < 3; c++) {
+        raw[c] = signal.channel(c);
+    }
+    re = signal.rescan();
+}
+
+void GreenPipeline::reset() {
+    denoising.reset();
+    normalizing.reset();
+    detrending.reset();
+}
+
+void GreenPipeline::update(SignalBuffer &signal, int dropped, double fps, int low, int high) {
+
+    // Views of the raw signal
+    raw[0] = signal.channel(1);
+    re = signal.rescan();
+
+    bool incremental = denoising.update(raw, 1, re, dropped);
+    normalizing.update(denoising.output(), dropped, !incremental);
+    detrending.update(denoising.output(), normalizing, fps, dropped);
+    smoothing.update(detrending.output(), fps);
+
+    // Let the spectrum see the signal unscaled, so that it only changes where the detrend did
+    outputScale = normalizing.stdDev(0);
+}
+
+void GreenPipeline::log(std::ostream &out) {
+    const Mat &s_den = normalizing.output();
+    const Mat &s_det = detrending.output();
+    const Mat &s_mav = smoothing.output();
+    out << "g;g_den;g_det;g_mav\n";
+    for (int i = 0; i < raw[0].rows; i++) {
+        out << raw[0].at<Sample>(i, 0) << ";";
+        out << s_den.at<Sample>(i, 0) << ";";
+        out << s_det.at<Sample>(i, 0) << ";";
+        out << s_mav.at<Sample>(i, 0) << "\n";
+    }
+}
+
+void PcaPipeline::reset() {
+    denoising.reset();
+    normalizing.reset();
+    detrending.reset();
+    projecting.reset();
+}
+
+void PcaPipeline::update(SignalBuffer &signal, int dropped, double fps, int low, int high) {
+
+    // Views of the raw signal
+    viewChannels(signal);
+
+    bool incremental = denoising.update(raw, 3, re, dropped);
+    normalizing.update(denoising.output(), dropped, !incremental);
+    detrending.update(denoising.output(), normalizing, fps, dropped);
+    projecting.update(detrending, dropped, low, high);
+    smoothing.update(projecting.output(), fps);
+    outputScale = 1;
+}
+
+void PcaPipeline::log(std::ostream &out) {
+    const Mat &s_den = normalizing.output();
+    const Mat &s_det = detrending.output();
+    const Mat &pc = projecting.components();
+    const Mat &s_pca = projecting.output();
+    const Mat &s_mav = smoothing.output();
+    out << "re;r;g;b;r_den;g_den;b_den;r_det;g_det;b_det;pc1;pc2;pc3;s_pca;s_mav\n";
+    for (int i = 0; i < raw[0].rows; i++) {
+        out << re.at<bool>(i, 0) << ";";
+        out << raw[0].at<Sample>(i, 0) << ";";
+        out << raw[1].at<Sample>(i, 0) << ";";
+        out << raw[2].at<Sample>(i, 0) << ";";
+        out << s_den.at<Sample>(i, 0) << ";";
+        out << s_den.at<Sample>(i, 1) << ";";
+        out << s_den.at<Sample>(i, 2) << ";";
+        out << s_det.at<Sample>(i, 0) << ";";
+        out << s_det.at<Sample>(i, 1) << ";";
+        out << s_det.at<Sample>(i, 2) << ";";
+        out << pc.at<Sample>(i, 0) << ";";
+        out << pc.at<Sample>(i, 1) << ";";
+        out << pc.at<Sample>(i, 2) << ";";
+        out << s_pca.at<Sample>(i, 0) << ";";
+        out << s_mav.at<Sample>(i, 0) << "\n";
+    }
+}
+
+void OverlapAddPipeline::reset() {
+    denoising.reset();
+    combining.reset();
+}
+
+void OverlapAddPipeline::update(SignalBuffer &signal, int dropped, double fps, int low, int high) {
+
+    // Views of the raw signal
+    viewChannels(signal);
+
+    bool incremental = denoising.update(raw, 3, re, dropped);
+    combining.update(denoising.output(), dropped, fps, !incremental);
+    smoothing.update(combining.output(), fps);
+    outputScale = 1;
+}
+
+void OverlapAddPipeline::log(std::ostream &out) {
+    const Mat &s_den = denoising.output();
+    const Mat &h = combining.output();
+    const Mat &s_f = smoothing.output();
+    out << "r;g;b;r_den;g_den;b_den;h;s_f\n";
+    for (int i = 0; i < raw[0].rows; i++) {
+        out << raw[0].at<Sample>(i, 0) << ";";
+        out << raw[1].at<Sample>(i, 0) << ";";
+        out << raw[2].at<Sample>(i, 0) << ";";
+        out << s_den.at<Sample>(i, 0) << ";";
+        out << s_den.at<Sample>(i, 1) << ";";
+        out << s_den.at<Sample>(i, 2) << ";";
+        out << h.at<Sample>(i, 0) << ";";
+        out << s_f.at<Sample>(i, 0) << "\n";
+    }
+}
+
+void XminayPipeline::reset() {
+    denoising.reset();
+    normalizing.reset();
+}
+
+void XminayPipeline::update(SignalBuffer &signal, int dropped, double fps, int low, int high) {
+
+    // Views of the raw signal
+    viewChannels(signal);
+
+    bool incremental = denoising.update(raw, 3, re, dropped);
+    normalizing.update(denoising.output(), dropped, !incremental);
+    const Mat &s_n = normalizing.output();
+
+    // Calculate X_s and Y_s signals
+    static const Sample xWeights[] = {3, -2, 0};
+    static const Sample yWeights[] = {1.5, 1, -1.5};
+    x_s.create(s_n.rows, 1, SAMPLE_TYPE);
+    y_s.create(s_n.rows, 1, SAMPLE_TYPE);
+    projectSamples(s_n.ptr<Sample>(0), x_s.ptr<Sample>(0), s_n.rows, s_n.cols, xWeights);
+    projectSamples(s_n.ptr<Sample>(0), y_s.ptr<Sample>(0), s_n.rows, s_n.cols, yWeights);
+
+    // Bandpass
+    bandpassingX.update(x_s, low, high);
+    bandpassingY.update(y_s, low, high);
+    const Mat &x_f = bandpassingX.output();
+    const Mat &y_f = bandpassingY.output();
+
+    // Calculate alpha
+    Scalar mean_x_f;
+    Scalar stddev_x_f;
+    meanStdDev(x_f, mean_x_f, stddev_x_f);
+    Scalar mean_y_f;
+    Scalar stddev_y_f;
+    meanStdDev(y_f, mean_y_f, stddev_y_f);
+    double alpha = stddev_x_f.val[0]/stddev_y_f.val[0];
+
+    // Calculate signal
+    xminay.create(x_f.rows, 1, SAMPLE_TYPE);
+    addWeightedSamples(x_f.ptr<Sample>(0), 1, y_f.ptr<Sample>(0), -alpha, xminay.ptr<Sample>(0), x_f.rows);
+
+    smoothing.update(xminay, fps);
+    outputScale = 1;
+}
+
+void XminayPipeline::log(std::ostream &out) {
+    const Mat &s_den = denoising.output();
+    const Mat &x_f = bandpassingX.output();
+    const Mat &y_f = bandpassingY.output();
+    const Mat &s_f = smoothing.output();
+    out << "r;g;b;r_den;g_den;b_den;x_s;y_s;x_f;y_f;s;s_f\n";
+    for (int i = 0; i < raw[0].rows; i++) {
+        out << raw[0].at<Sample>(i, 0) << ";";
+        out << raw[1].at<Sample>(i, 0) << ";";
+        out << raw[2].at<Sample>(i, 0) << ";";
+        out << s_den.at<Sample>(i, 0) << ";";
+        out << s_den.at<Sample>(i, 1) << ";";
+        out << s_den.at<Sample>(i, 2) << ";";
+        out << x_s.at<Sample>(i, 0) << ";";
+        out << y_s.at<Sample>(i, 0) << ";";
+        out << x_f.at<Sample>(i, 0) << ";";
+        out << y_f.at<Sample>(i, 0) << ";";
+        out << xminay.at<Sample>(i, 0) << ";";
+        out << s_f.at<Sample>(i, 0) << "\n";
+    }
+}
@@ -0,0 +1,343 @@
+//
+//  SignalPipeline.hpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#ifndef SignalPipeline_hpp
+#define SignalPipeline_hpp
+
+#include <ostream>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "opencv.hpp"
+#include "SignalBuffer.hpp"
+
+enum RPPGAlgorithm { g, pca, xminay, pos, chrom };
+
+/* STAGES */
+
+// Each stage keeps its state between frames and owns its output, which stays valid until its next update.
+// Inputs are the previous input without its first dropped rows plus new rows.
+
+// Removes the jumps at rescans, correcting only new rows
+class DenoiseStage {
+
+public:
+
+    void reset();
+
+    // Channels are single-column views, corrected into the columns of the output.
+    // Returns false if the whole window had to be recomputed.
+    bool update(const cv::Mat *channels, int count, const cv::Mat &re, int dropped);
+
+    const cv::Mat &output() const { return out; }
+
+private:
+
+    cv::DenoiseFilter filter;
+    cv::Mat out;
+};
+
+// Mean and standard deviation per column, updated with Welford's method as rows enter and leave
+class NormalizeStage {
+
+public:
+
+    NormalizeStage() { reset(); }
+
+    void reset();
+
+    // Restart discards the running statistics, e.g. after the input was recomputed
+    void update(const cv::Mat &s, int dropped, bool restart);
+
+    double mean(int c) const { return means[c]; }
+    double stdDev(int c) const;
+
+    // Normalised window, only computed when asked for
+    const cv::Mat &output();
+
+private:
+
+    void add(const cv::Sample *row);
+    void remove(const cv::Sample *row);
+
+    int rows;
+    int cols;
+    int first;
+    int updates;
+    bool normalised;
+
+    // Copy of the window, so that leaving rows can be removed from the statistics
+    std::vector<cv::Sample> window;
+
+    std::vector<double> means;
+    std::vector<double> m2;
+    std::vector<cv::Sample> offsets;                                            // Column patterns
+    std::vector<cv::Sample> scales;
+    cv::Mat out;
+};
+
+// Smoothness priors detrending of the unnormalised input, scaled by the normalisation afterwards
+class DetrendStage {
+
+public:
+
+    void reset();
+    void update(const cv::Mat &s, const NormalizeStage &normalize, int lambda, int dropped);
+
+    const cv::Mat &output() const { return out; }
+
+    // Detrended signal before scaling, and the factor applied to column c
+    const cv::Mat &unscaled() const { return detrended; }
+    cv::Sample scale(int c) const { return scales[c]; }
+
+private:
+
+    cv::IncrementalDetrendFilter filter;
+    cv::DetrendFilter batch;
+    std::vector<cv::Sample> zeros;                                              // Column patterns
+    std::vector<cv::Sample> scales;
+    cv::Mat detrended;
+    cv::Mat out;
+};
+
+// Projection of three channels on the principal component with the most distinct in-band peak.
+// The covariance is kept as running sums over the unscaled detrended signal, updated only for rows
+// that enter, leave or change, and diagonalised in closed form. The components are linear in the
+// channels, so one DFT pass over the channels serves the spectra of all three.
+class PcaStage {
+
+public:
+
+    PcaStage() { reset(); }
+
+    void reset();
+    void update(const DetrendStage &detrend, int dropped, int low, int high);
+
+    const cv::Mat &output() const { return out; }
+
+    // All three components, only computed when asked for
+    const cv::Mat &components();
+
+private:
+
+    void accumulate(const cv::Sample *row, double weight);
+    void select(const cv::Mat &s, int low, int high);
+
+    int rows;
+    int first;
+    int updates;
+    int selected;
+    bool oriented;
+
+    // Copy of the unscaled window, to find the rows that changed
+    std::vector<cv::Sample> window;
+
+    // Sums and sums of products {00, 01, 02, 11, 12, 22}
+    double sums[3];
+    double products[6];
+
+    // Eigenvectors as rows, in descending order of variance
+    double vectors[3][3];
+
+    cv::Mat input;
+    cv::Mat planes;
+    cv::Mat spectra;
+    cv::Mat out;
+    cv::Mat pc;
+};
+
+// Overlap-add of short windows, each projected by h = S1 + σ(S1)/σ(S2) * S2 with S = P * C / mean(C),
+// and made zero mean. The statistics of a window come from its sums and sums of products, so each
+// window reduces to a weight per channel and an offset, which are kept while the window overlaps
+// the signal. Windows that have been added are not revisited, so old rows of the output are stable.
+class OverlapAddStage {
+
+public:
+
+    // Rows of P
+    OverlapAddStage(const double first[3], const double second[3]);
+
+    void reset();
+
+    // Restart discards the windows, e.g. after the input was recomputed
+    void update(const cv::Mat &s, int dropped, double fps, bool restart);
+
+    const cv::Mat &output() const { return out; }
+
+private:
+
+    void addWindow(const cv::Mat &s, int start);
+
+    double projection[2][3];
+    int length;
+
+    // Start of the first window relative to the first row
+    int start;
+
+    // {w0, w1, w2, offset} of each window
+    std::vector<double> windows;
+
+    cv::Mat out;
+};
+
+// Butterworth bandpass of a column
+class BandpassStage {
+
+public:
+
+    void update(const cv::Mat &s, double low, double high);
+
+    const cv::Mat &output() const { return out; }
+
+private:
+
+    cv::SpectralEngine engine;
+    cv::Mat out;
+};
+
+// Cascaded moving average, timed
+class SmoothStage {
+
+public:
+
+    SmoothStage() : duration(0) {;}
+
+    void update(const cv::Mat &s, double fps);
+
+    const cv::Mat &output() const { return out; }
+
+    // Milliseconds taken by the last update
+    double time() const { return duration; }
+
+private:
+
+    double duration;
+    std::vector<cv::Sample> scratch;
+    cv::Mat out;
+};
+
+/* PIPELINES */
+
+// The chain of stages turning the raw signal into the signal for PSD estimation
+class SignalPipeline {
+
+public:
+
+    static cv::Ptr<SignalPipeline> create(RPPGAlgorithm algorithm);
+
+    SignalPipeline() : outputScale(1) {;}
+    virtual ~SignalPipeline() {;}
+
+    // Forget all state
+    virtual void reset() = 0;
+
+    // Process the window after dropped samples left the front of the signal and new samples were pushed
+    virtual void update(SignalBuffer &signal, int dropped, double fps, int low, int high) = 0;
+
+    // Write the stages of the last update as CSV
+    virtual void log(std::ostream &out) = 0;
+
+    const cv::Mat &output() const { return smoothing.output(); }
+
+    // Factor undoing the normalisation of the output, so that its overlap with the last frame is stable
+    double scale() const { return outputScale; }
+
+    double smoothingTime() const { return smoothing.time(); }
+
+    // Whether old rows of the output mostly keep their values between updates, so that a sliding spectrum pays off
+    virtual bool isSliding() const { return true; }
+
+protected:
+
+    // View all three channels and the rescan flags of the signal
+    void viewChannels(SignalBuffer &signal);
+
+    // Views of the raw channels of the last update
+    cv::Mat raw[3];
+    cv::Mat re;
+
+    SmoothStage smoothing;
+    double outputScale;
+};
+
+// Green channel
+class GreenPipeline : public SignalPipeline {
+
+public:
+
+    void reset();
+    void update(SignalBuffer &signal, int dropped, double fps, int low, int high);
+    void log(std::ostream &out);
+
+private:
+
+    DenoiseStage denoising;
+    NormalizeStage normalizing;
+    DetrendStage detrending;
+};
+
+// PCA of all channels
+class PcaPipeline : public SignalPipeline {
+
+public:
+
+    void reset();
+    void update(SignalBuffer &signal, int dropped, double fps, int low, int high);
+    void log(std::ostream &out);
+
+    // Renormalised and reprojected on every update
+    bool isSliding() const { return false; }
+
+private:
+
+    DenoiseStage denoising;
+    NormalizeStage normalizing;
+    DetrendStage detrending;
+    PcaStage projecting;
+};
+
+// Overlap-add of short windows, POS or CHROM depending on the projection
+class OverlapAddPipeline : public SignalPipeline {
+
+public:
+
+    OverlapAddPipeline(const double first[3], const double second[3]) : combining(first, second) {;}
+
+    void reset();
+    void update(SignalBuffer &signal, int dropped, double fps, int low, int high);
+    void log(std::ostream &out);
+
+private:
+
+    DenoiseStage denoising;
+    OverlapAddStage combining;
+};
+
+// Chrominance X - αY of all channels
+class XminayPipeline : public SignalPipeline {
+
+public:
+
+    void reset();
+    void update(SignalBuffer &signal, int dropped, double fps, int low, int high);
+    void log(std::ostream &out);
+
+    // Bandpassed and rescaled by α on every update
+    bool isSliding() const { return false; }
+
+private:
+
+    DenoiseStage denoising;
+    NormalizeStage normalizing;
+    BandpassStage bandpassingX;
+    BandpassStage bandpassingY;
+    cv::Mat x_s;
+    cv::Mat y_s;
+    cv::Mat xminay;
+};
+
+#endif /* SignalPipeline_hpp */
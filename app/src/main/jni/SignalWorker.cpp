@@ -0,0 +1,199 @@
+//
+//  SignalWorker.cpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#include "SignalWorker.hpp"
+
+#include <chrono>
+#include <sstream>
+#include <android/log.h>
+
+using namespace cv;
+using namespace std;
+
+#define QUEUE_CAPACITY 256
+#define WAIT_MILLIS 5
+
+#define LOG_TAG "Heartbeat::SignalWorker"
+#define LOGD(...) ((void)__android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__))
+
+// Filters and estimates a range of faces, each on its own state
+class FaceProcessor : public ParallelLoopBody {
+
+public:
+
+    FaceProcessor(vector<Ptr<FaceSignal> > &signals, vector<uchar> &due, int64_t time, bool defer) : signals(signals), due(due), time(time), defer(defer) {;}
+
+    void operator()(const Range &range) const {
+        for (int i = range.start; i < range.end; i++) {
+            due[i] = signals[i]->process(time, defer);
+        }
+    }
+
+private:
+
+    vector<Ptr<FaceSignal> > &signals;
+    vector<uchar> &due;
+    int64_t time;
+    bool defer;
+};
+
+void SignalWorker::load(const RPPGSettings &settings, SignalListener *listener) {
+    stop();
+    this->settings = &settings;
+    this->listener = listener;
+
+    // Logging bpm according to sampling frequency
+    std::ostringstream path_1;
+    path_1 << settings.logfilepath << "_bpm.csv";
+    logfile.open(path_1.str().c_str());
+    logfile << "time;face;face_valid;mean;min;max\n";
+    logfile.flush();
+
+    // Logging bpm detailed
+    std::ostringstream path_2;
+    path_2 << settings.logfilepath << "_bpmAll.csv";
+    logfileDetailed.open(path_2.str().c_str());
+    logfileDetailed << "time;face;face_valid;bpm\n";
+    logfileDetailed.flush();
+
+    queue.allocate(QUEUE_CAPACITY);
+    processedTime = 0;
+    deferredEstimations = 0;
+    processedFrames = 0;
+    processingTicks = 0;
+    running = true;
+    thread = std::thread(&SignalWorker::run, this);
+}
+
+void SignalWorker::stop() {
+    if (!running) {
+        return;
+    }
+    running = false;
+    condition.notify_one();
+    thread.join();
+    signals.clear();
+    sampled.clear();
+    displays.clear();
+    logfile.close();
+    logfileDetailed.close();
+}
+
+void SignalWorker::push(const FaceSample &sample) {
+
+    if (!running) {
+        return;
+    }
+
+    // The worker is behind by a whole queue, wait for it instead of losing the sample
+    if (!queue.push(sample)) {
+        LOGD("Queue full, waiting for the signal worker");
+        while (!queue.push(sample)) {
+            std::this_thread::yield();
+        }
+    }
+
+    // Without the lock; a missed wake-up only delays the worker by WAIT_MILLIS
+    condition.notify_one();
+}
+
+bool SignalWorker::display(int face, FaceDisplay &display) {
+    lock_guard<std::mutex> lock(mutex);
+    map<int, FaceDisplay>::const_iterator it = displays.find(face);
+    if (it == displays.end()) {
+        return false;
+    }
+    display = it->second;
+    return true;
+}
+
+void SignalWorker::run() {
+
+    FaceSample sample;
+
+    while (running) {
+
+        if (!queue.pop(sample)) {
+            unique_lock<std::mutex> lock(mutex);
+            condition.wait_for(lock, std::chrono::milliseconds(WAIT_MILLIS), [this] { return !running || !queue.empty(); });
+            continue;
+        }
+
+        handle(sample);
+    }
+
+    listener->onWorkerExit();
+}
+
+void SignalWorker::handle(const FaceSample &sample) {
+
+    switch (sample.kind) {
+
+        case FaceSample::sample: {
+            Ptr<FaceSignal> &signal = signals[sample.face];
+            if (!signal) {
+                signal = Ptr<FaceSignal>(new FaceSignal(sample.face, *settings));
+            }
+            signal->push(sample);
+            sampled.push_back(signal);
+            break;
+        }
+
+        case FaceSample::lost: {
+            signals.erase(sample.face);
+            lock_guard<std::mutex> lock(mutex);
+            displays.erase(sample.face);
+            break;
+        }
+
+        case FaceSample::frame:
+            processFrame(sample.time, sample.defer);
+            break;
+    }
+}
+
+void SignalWorker::processFrame(int64_t time, bool defer) {
+
+    const int64 start = getTickCount();
+
+    // Filter and estimate the faces sampled in this frame in parallel
+    vector<uchar> due(sampled.size(), 0);
+    if (!sampled.empty()) {
+        parallel_for_(Range(0, (int)sampled.size()), FaceProcessor(sampled, due, time, defer));
+        for (size_t i = 0; i < sampled.size(); i++) {
+            if (sampled[i]->wasDeferred()) {
+                deferredEstimations++;
+            }
+        }
+    }
+
+    // Report and log in order
+    for (size_t i = 0; i < sampled.size(); i++) {
+
+        const FaceSignal &signal = *sampled[i];
+
+        if (due[i]) {
+            listener->onResult(signal.getId(), time, signal.getMeanBpm(), signal.getMinBpm(), signal.getMaxBpm(), signal.isProvisional());
+        }
+
+        if (signal.isReady()) {
+            signal.log(logfile, logfileDetailed, time);
+        }
+
+        if (settings->guiMode) {
+            FaceDisplay display;
+            signal.display(display);
+            lock_guard<std::mutex> lock(mutex);
+            displays[signal.getId()] = display;
+        }
+    }
+
+    sampled.clear();
+    processingTicks += getTickCount() - start;
+    processedFrames++;
+    processedTime = time;
+}
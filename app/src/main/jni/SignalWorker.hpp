@@ -0,0 +1,101 @@
+//
+//  SignalWorker.hpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#ifndef SignalWorker_hpp
+#define SignalWorker_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "Face.hpp"
+#include "FaceSignal.hpp"
+#include "SampleQueue.hpp"
+
+// Receives the results of the signal worker, on its thread
+class SignalListener {
+
+public:
+
+    virtual ~SignalListener() {;}
+
+    virtual void onResult(int face, int64_t time, double meanBpm, double minBpm, double maxBpm, bool provisional) = 0;
+
+    // The last call on the worker thread before it ends
+    virtual void onWorkerExit() = 0;
+};
+
+// Runs the back stage of the pipeline on its own thread: the raw signals of the faces, filtering,
+// estimation, logging and the results. The camera thread only pushes the samples of the faces into
+// a lock-free queue, closing each frame with a marker, so that it never waits for the signal processing.
+class SignalWorker {
+
+public:
+
+    SignalWorker() : settings(NULL), listener(NULL), running(false), processedTime(0), deferredEstimations(0), processedFrames(0), processingTicks(0) {;}
+    ~SignalWorker() { stop(); }
+
+    // Open the logs and start the thread
+    void load(const RPPGSettings &settings, SignalListener *listener);
+
+    // Stop the thread, discarding samples that are still queued
+    void stop();
+
+    // Camera thread: queue a sample or marker, waiting for room rather than dropping it
+    void push(const FaceSample &sample);
+
+    // Camera thread: the state of a face as last published, false if there is none
+    bool display(int face, FaceDisplay &display);
+
+    // Any thread: time of the last frame the worker finished, 0 before the first
+    int64_t getProcessedTime() const { return processedTime; }
+
+    // Any thread: estimations that were due but deferred since loading
+    int64_t getDeferredEstimations() const { return deferredEstimations; }
+
+    // Any thread: frames finished since loading and the ticks spent on them
+    int64_t getProcessedFrames() const { return processedFrames; }
+    int64_t getProcessingTicks() const { return processingTicks; }
+
+private:
+
+    void run();
+    void handle(const FaceSample &sample);
+    void processFrame(int64_t time, bool defer);
+
+    const RPPGSettings *settings;
+    SignalListener *listener;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::atomic<bool> running;
+    SampleQueue<FaceSample> queue;
+
+    // Worker thread only
+    std::map<int, cv::Ptr<FaceSignal> > signals;
+    std::vector<cv::Ptr<FaceSignal> > sampled;
+    std::ofstream logfile;
+    std::ofstream logfileDetailed;
+
+    // Shared under the mutex
+    std::map<int, FaceDisplay> displays;
+
+    // Written by the worker only
+    std::atomic<int64_t> processedTime;
+    std::atomic<int64_t> deferredEstimations;
+    std::atomic<int64_t> processedFrames;
+    std::atomic<int64_t> processingTicks;
+};
+
+#endif /* SignalWorker_hpp */
@@ -3,7 +3,9 @@
 //
 
 #include "com_prouast_heartbeat_RPPG.h"
+#include <sstream>
 #include <android/log.h>
+#include "Benchmark.hpp"
 #include "RPPG.hpp"
 
 #define LOG_TAG "Heartbeat::RPPG"
@@ -41,12 +43,12 @@ JNIEXPORT jlong JNICALL Java_com_prouast_heartbeat_RPPG__1initialise
 /*
  * Class:     com_prouast_heartbeat_RPPG
  * Method:    _load
- * Signature: (JLcom/prouast/heartbeat/RPPG/RPPGListener;IIIDIDDIILjava/lang/String;Ljava/lang/String;ZZ)V
+ * Signature: (JLcom/prouast/heartbeat/RPPG/RPPGListener;IIIIIDIDDDIIDIILjava/lang/String;Ljava/lang/String;ZZ)V
  */
 JNIEXPORT void JNICALL Java_com_prouast_heartbeat_RPPG__1load
-(JNIEnv *jenv, jclass, jlong self, jobject jlistener, jint jalgorithm, jint jwidth, jint jheight,
-jdouble jtimeBase, jint jdownsample, jdouble jsamplingFrequency, jdouble jrescanFrequency,
-jint jminSignalSize, jint jmaxSignalSize, jstring jlogPath, jstring jclassifierPath,
+(JNIEnv *jenv, jclass, jlong self, jobject jlistener, jint jalgorithm, jint jdetector, jint jmaxFaces, jint jwidth, jint jheight,
+jdouble jtimeBase, jint jdownsample, jdouble jsamplingFrequency, jdouble jrescanFrequency, jdouble jframeBudget,
+jint jestimationHopSamples, jint jestimationHopMillis, jdouble jprogressiveSignalSize, jint jminSignalSize, jint jmaxSignalSize, jstring jlogPath, jstring jclassifierPath,
 jboolean jlog, jboolean jgui) {
     LOGD("Java_com_prouast_heartbeat_RPPG__1load enter");
     bool log = jlog;
@@ -55,9 +57,13 @@ jboolean jlog, jboolean jgui) {
     try {
         GetJStringContent(jenv, jlogPath, logPath);
         GetJStringContent(jenv, jclassifierPath, classifierPath);
-        ((RPPG *)self)->load(jlistener, jenv, jalgorithm, jwidth, jheight, jtimeBase, jdownsample,
-                                   jsamplingFrequency, jrescanFrequency, jminSignalSize, jmaxSignalSize,
-                                   logPath, classifierPath, log, gui);
+        if (!((RPPG *)self)->load(jlistener, jenv, jalgorithm, jdetector, jmaxFaces, jwidth, jheight, jtimeBase, jdownsample,
+                                   jsamplingFrequency, jrescanFrequency, jframeBudget,
+                                   jestimationHopSamples, jestimationHopMillis, jprogressiveSignalSize, jminSignalSize, jmaxSignalSize,
+                                   logPath, classifierPath, log, gui)) {
+            jclass je = jenv->FindClass("java/lang/IllegalArgumentException");
+            jenv->ThrowNew(je, "Failed to load the face detector.");
+        }
     } catch (...) {
       jclass je = jenv->FindClass("java/lang/Exception");
       jenv->ThrowNew(je, "Unknown exception in JNI code.");
@@ -98,4 +104,59 @@ JNIEXPORT void JNICALL Java_com_prouast_heartbeat_RPPG__1exit
         jenv->ThrowNew(je, "Unknown exception in JNI code.");
     }
     LOGD("Java_com_prouast_heartbeat_RPPG__1exit exit");
-}
\ No newline at end of file
+}
+
+/*
+ * Class:     com_prouast_heartbeat_RPPG
+ * Method:    _getCounters
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_prouast_heartbeat_RPPG__1getCounters
+(JNIEnv *jenv, jclass, jlong self) {
+    jlongArray result = NULL;
+    try {
+        RPPGCounters counters = ((RPPG *)self)->getCounters();
+        jlong values[] = {counters.frames, counters.deadlineMisses, counters.skippedDrawings,
+                          counters.deferredEstimations, counters.deferredRescans};
+        result = jenv->NewLongArray(5);
+        jenv->SetLongArrayRegion(result, 0, 5, values);
+    } catch (...) {
+        jclass je = jenv->FindClass("java/lang/Exception");
+        jenv->ThrowNew(je, "Unknown exception in JNI code.");
+    }
+    return result;
+}
+
+/*
+ * Class:     com_prouast_heartbeat_RPPG
+ * Method:    _benchmark
+ * Signature: (Ljava/lang/String;DIILjava/lang/String;Ljava/lang/String;)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_com_prouast_heartbeat_RPPG__1benchmark
+(JNIEnv *jenv, jclass, jstring jframePattern, jdouble jfps, jint jalgorithm, jint jdetector, jstring jlogPath, jstring jclassifierPath) {
+    LOGD("Java_com_prouast_heartbeat_RPPG__1benchmark enter");
+    jstring result = NULL;
+    std::string framePattern, logPath, classifierPath;
+    try {
+        GetJStringContent(jenv, jframePattern, framePattern);
+        GetJStringContent(jenv, jlogPath, logPath);
+        GetJStringContent(jenv, jclassifierPath, classifierPath);
+        std::ostringstream report;
+        Benchmark benchmark(jalgorithm, jdetector, classifierPath, logPath);
+        if (benchmark.replay(framePattern, jfps, report)) {
+            benchmark.smoothing(report);
+            if (!benchmark.detrending(report)) {
+                LOGD("Incremental detrend exceeded its error bound");
+            }
+            result = jenv->NewStringUTF(report.str().c_str());
+        } else {
+            jclass je = jenv->FindClass("java/lang/IllegalArgumentException");
+            jenv->ThrowNew(je, "No frames to replay or failed to load the face detector.");
+        }
+    } catch (...) {
+        jclass je = jenv->FindClass("java/lang/Exception");
+        jenv->ThrowNew(je, "Unknown exception in JNI code.");
+    }
+    LOGD("Java_com_prouast_heartbeat_RPPG__1benchmark exit");
+    return result;
+}
@@ -18,10 +18,10 @@ JNIEXPORT jlong JNICALL Java_com_prouast_heartbeat_RPPG__1initialise
 /*
  * Class:     com_prouast_heartbeat_RPPG
  * Method:    _load
- * Signature: (JLcom/prouast/heartbeat/RPPG/RPPGListener;IIIDIDDIILjava/lang/String;Ljava/lang/String;ZZ)V
+ * Signature: (JLcom/prouast/heartbeat/RPPG/RPPGListener;IIIIIDIDDDIIDIILjava/lang/String;Ljava/lang/String;ZZ)V
  */
 JNIEXPORT void JNICALL Java_com_prouast_heartbeat_RPPG__1load
-  (JNIEnv *, jclass, jlong, jobject, jint, jint, jint, jdouble, jint, jdouble, jdouble, jint, jint, jstring, jstring, jboolean, jboolean);
+  (JNIEnv *, jclass, jlong, jobject, jint, jint, jint, jint, jint, jdouble, jint, jdouble, jdouble, jdouble, jint, jint, jdouble, jint, jint, jstring, jstring, jboolean, jboolean);
 
 /*
  * Class:     com_prouast_heartbeat_RPPG
@@ -39,6 +39,22 @@ JNIEXPORT void JNICALL Java_com_prouast_heartbeat_RPPG__1processFrame
 JNIEXPORT void JNICALL Java_com_prouast_heartbeat_RPPG__1exit
   (JNIEnv *, jclass, jlong);
 
+/*
+ * Class:     com_prouast_heartbeat_RPPG
+ * Method:    _getCounters
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_com_prouast_heartbeat_RPPG__1getCounters
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     com_prouast_heartbeat_RPPG
+ * Method:    _benchmark
+ * Signature: (Ljava/lang/String;DIILjava/lang/String;Ljava/lang/String;)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_com_prouast_heartbeat_RPPG__1benchmark
+  (JNIEnv *, jclass, jstring, jdouble, jint, jint, jstring, jstring);
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,6 +8,7 @@
 
 #include "opencv.hpp"
 
+#include <complex>
 #include <limits>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -18,22 +19,6 @@ namespace cv {
     
     /* COMMON FUNCTIONS */
     
-    double getFps(Mat &t, const double timeBase) {
-        
-        double result;
-        
-        if (t.empty()) {
-            result = 1.0;
-        } else if (t.rows == 1) {
-            result = std::numeric_limits<double>::max();
-        } else {
-            double diff = (t.at<long>(t.rows-1, 0) - t.at<long>(0, 0)) * timeBase;
-            result = diff == 0 ? std::numeric_limits<double>::max() : t.rows/diff;
-        }
-        
-        return result;
-    }
-    
     void push(Mat &m) {
         const int length = m.rows;
         m.rowRange(1, length).copyTo(m.rowRange(0, length - 1));
@@ -112,92 +97,94 @@ namespace cv {
     // Eliminate jumps
     void denoise(InputArray _a, InputArray _jumps, OutputArray _b) {
 
-        Mat a = _a.getMat().clone();
-        Mat jumps = _jumps.getMat().clone();
+        Mat a = _a.getMat();
+        Mat jumps = _jumps.getMat();
 
-        CV_Assert(a.type() == CV_64F && jumps.type() == CV_8U);
+        CV_Assert(a.type() == SAMPLE_TYPE && jumps.type() == CV_8U && jumps.rows >= a.rows);
 
-        if (jumps.rows != a.rows) {
-            jumps.rowRange(jumps.rows-a.rows, jumps.rows).copyTo(jumps);
-        }
+        // Align jumps with the end of the signal
+        const int shift = jumps.rows - a.rows;
 
-        Mat diff;
-        subtract(a.rowRange(1, a.rows), a.rowRange(0, a.rows-1), diff);
+        _b.create(a.rows, a.cols, SAMPLE_TYPE);
+        Mat b = _b.getMat();
 
-        for (int i = 1; i < jumps.rows; i++) {
-            if (jumps.at<bool>(i, 0)) {
-                Mat mask = Mat::zeros(a.size(), CV_8U);
-                mask.rowRange(i, mask.rows).setTo(ONE);
-                for (int j = 0; j < a.cols; j++) {
-                    add(a.col(j), -diff.at<double>(i-1, j), a.col(j), mask.col(j));
+        // Running offset and previous input per column; b may alias a
+        std::vector<double> offset(a.cols, 0);
+        std::vector<double> previous(a.cols, 0);
+
+        for (int i = 0; i < a.rows; i++) {
+            const Sample *ai = a.ptr<Sample>(i);
+            Sample *bi = b.ptr<Sample>(i);
+            const bool jump = i > 0 && jumps.at<uchar>(i + shift, 0);
+            for (int j = 0; j < a.cols; j++) {
+                const double value = ai[j];
+                if (jump) {
+                    offset[j] -= value - previous[j];
                 }
+                previous[j] = value;
+                bi[j] = value + offset[j];
             }
         }
-
-        a.copyTo(_b);
     }
 
-    // Advanced detrending filter based on smoothness priors approach (High pass equivalent)
+    // Advanced detrending filter based on smoothness priors approach (High pass equivalent).
+    // Factorises on every call, callers that filter repeatedly keep their own DetrendFilter.
     void detrend(InputArray _a, OutputArray _b, int lambda) {
+        DetrendFilter filter;
+        filter.apply(_a, _b, lambda);
+    }
 
-        Mat a = _a.getMat();
-        CV_Assert(a.type() == CV_64F);
+    // One box filter pass of width s from x to y, which may be x, bordered like cv::blur (BORDER_REFLECT_101)
+    static void boxFilter1D(const Sample *x, Sample *y, int rows, int s, Sample *padded) {
 
-        // Number of rows
-        int rows = a.rows;
+        // Extend both ends, anchored at the centre
+        const int before = s / 2;
+        const int length = rows + s - 1;
+        for (int i = 0; i < length; i++) {
+            padded[i + 1] = x[cv::borderInterpolate(i - before, rows, BORDER_REFLECT_101)];
+        }
 
-        if (rows < 3) {
-            a.copyTo(_b);
-        } else {
-            // Construct I
-            Mat i = Mat::eye(rows, rows, a.type());
-            // Construct D2
-            Mat d = Mat(Matx<double,1,3>(1, -2, 1));
-            Mat d2Aux = Mat::ones(rows-2, 1, a.type()) * d;
-            Mat d2 = Mat::zeros(rows-2, rows, a.type());
-            for (int k = 0; k < 3; k++) {
-                d2Aux.col(k).copyTo(d2.diag(k));
-            }
-            // Calculate b = (I - (I + λ^2 * D2^t*D2)^-1) * a
-            Mat b = (i - (i + lambda * lambda * d2.t() * d2).inv()) * a;
-            b.copyTo(_b);
+        // Running sum, then each output is one difference
+        padded[0] = 0;
+        for (int i = 1; i <= length; i++) {
+            padded[i] += padded[i - 1];
         }
+        differenceSamples(padded, y, rows, s, (Sample)1 / s);
     }
 
-    // Moving average filter (low pass equivalent)
+    // Moving average filter (low pass equivalent) with n cascaded box filters of width s
     void movingAverage(InputArray _a, OutputArray _b, int n, int s) {
-        _a.getMat().copyTo(_b);
-        Mat b = _b.getMat();
-        for (size_t i = 0; i < n; i++) {
-            cv::blur(b, b, Size(s, s));
-        }
+        std::vector<Sample> scratch;
+        movingAverage(_a, _b, n, s, scratch);
     }
 
-    // Bandpass filter
-    void bandpass(cv::InputArray _a, cv::OutputArray _b, double low, double high) {
-
+    void movingAverage(InputArray _a, OutputArray _b, int n, int s, std::vector<Sample> &scratch) {
         Mat a = _a.getMat();
-
-        if (a.total() < 3) {
-            a.copyTo(_b);
+        if (a.cols == 1 && a.type() == SAMPLE_TYPE && a.isContinuous() && n > 0) {
+            // On a single column, the s x s blur reduces to a vertical box of width s.
+            // The first pass reads the input, the others work on the output in place.
+            _b.create(a.rows, 1, SAMPLE_TYPE);
+            Mat b = _b.getMat();
+            scratch.resize(a.rows + s);
+            boxFilter1D(a.ptr<Sample>(0), b.ptr<Sample>(0), a.rows, s, &scratch[0]);
+            for (int i = 1; i < n; i++) {
+                boxFilter1D(b.ptr<Sample>(0), b.ptr<Sample>(0), b.rows, s, &scratch[0]);
+            }
         } else {
-
-            // Convert to frequency domain
-            Mat frequencySpectrum = Mat(a.rows, a.cols, CV_32F);
-            timeToFrequency(a, frequencySpectrum, false);
-
-            // Make the filter
-            Mat filter = frequencySpectrum.clone();
-            butterworth_bandpass_filter(filter, low, high, 8);
-
-            // Apply the filter
-            multiply(frequencySpectrum, filter, frequencySpectrum);
-
-            // Convert to time domain
-            frequencyToTime(frequencySpectrum, _b);
+            a.copyTo(_b);
+            Mat b = _b.getMat();
+            for (int i = 0; i < n; i++) {
+                cv::blur(b, b, Size(s, s));
+            }
         }
     }
 
+    // Bandpass filter. Plans and responses are not cached across calls, callers that filter repeatedly keep their own SpectralEngine.
+    void bandpass(cv::InputArray _a, cv::OutputArray _b, double low, double high) {
+        SpectralEngine engine;
+        engine.bandpass(_a, _b, low, high);
+    }
+
     void butterworth_lowpass_filter(Mat &filter, double cutoff, int n) {
         CV_DbgAssert(cutoff > 0 && n > 0 && filter.rows % 2 == 0 && filter.cols % 2 == 0);
 
@@ -231,7 +218,7 @@ namespace cv {
 
         // Prepare planes
         Mat a = _a.getMat();
-        Mat planes[] = {cv::Mat_<float>(a), cv::Mat::zeros(a.size(), CV_32F)};
+        Mat planes[] = {cv::Mat_<Sample>(a), cv::Mat::zeros(a.size(), SAMPLE_TYPE)};
         Mat powerSpectrum;
         merge(planes, 2, powerSpectrum);
 
@@ -262,53 +249,623 @@ namespace cv {
         output.copyTo(_b);
     }
 
-    void pcaComponent(cv::InputArray _a, cv::OutputArray _b, cv::OutputArray _pc, int low, int high) {
+    /* STATEFUL FILTERS */
+
+    void DenoiseFilter::reset() {
+        rows = 0;
+        cols = 0;
+        first = 0;
+        output.clear();
+    }
+
+    bool DenoiseFilter::apply(const Mat *channels, int count, InputArray _jumps, OutputArray _b, int dropped) {
+
+        Mat jumps = _jumps.getMat();
+        const int length = channels[0].rows;
+
+        CV_Assert(count > 0 && jumps.type() == CV_8U && jumps.rows >= length);
+        for (int j = 0; j < count; j++) {
+            CV_Assert(channels[j].type() == SAMPLE_TYPE && channels[j].cols == 1 && channels[j].rows == length);
+        }
+
+        const int kept = this->rows - dropped;
+        const int shift = jumps.rows - length;
+
+        // The last input row must still be where it was
+        bool incremental = count == cols && kept > 0 && kept <= length;
+        for (int j = 0; j < cols && incremental; j++) {
+            incremental = channels[j].at<Sample>(kept - 1, 0) == previous[j];
+        }
+
+        int start = kept;
+        if (incremental) {
+
+            // Discard dropped rows, compacting once the discarded prefix outgrows the window
+            first += dropped;
+            if (first > length) {
+                output.erase(output.begin(), output.begin() + first * cols);
+                first = 0;
+            }
+
+        } else {
+
+            // Start over from the first row, which has no jump to remove, as in denoise()
+            cols = count;
+            first = 0;
+            start = 0;
+            output.clear();
+            offset.assign(cols, 0);
+            previous.assign(cols, 0);
+        }
+
+        // Correct new rows only, continuing the running offset
+        for (int i = start; i < length; i++) {
+            const bool jump = i > 0 && jumps.at<uchar>(i + shift, 0) != 0;
+            for (int j = 0; j < cols; j++) {
+                const Sample value = channels[j].at<Sample>(i, 0);
+                if (jump) {
+                    offset[j] -= value - previous[j];
+                }
+                previous[j] = value;
+                output.push_back(value + offset[j]);
+            }
+        }
+
+        rows = length;
+        Mat(rows, cols, SAMPLE_TYPE, output.data() + first * cols).copyTo(_b);
+
+        return incremental;
+    }
+
+    /* SPECTRAL */
+
+    bool SpectralEngine::ResponseKey::operator<(const ResponseKey &k) const {
+        if (size != k.size) return size < k.size;
+        if (rows != k.rows) return rows < k.rows;
+        if (order != k.order) return order < k.order;
+        if (low != k.low) return low < k.low;
+        return high < k.high;
+    }
+
+    void SpectralEngine::forward(const Mat &a, int size) {
+
+        CV_Assert(a.cols == 1 && a.type() == SAMPLE_TYPE);
+
+        // Copy the column into a zero padded row
+        buffer.create(1, size, SAMPLE_TYPE);
+        Sample *x = buffer.ptr<Sample>(0);
+        for (int i = 0; i < a.rows; i++) {
+            x[i] = a.at<Sample>(i, 0);
+        }
+        std::fill(x + a.rows, x + size, (Sample)0);
+
+        // Packed spectrum Re0, Re1, Im1, Re2, Im2, ...
+        dft(buffer, spectrum);
+    }
+
+    const Mat &SpectralEngine::transform(InputArray _a, int size) {
+        forward(_a.getMat(), size);
+        return spectrum;
+    }
+
+    void SpectralEngine::magnitude(InputArray _a, OutputArray _b) {
 
         Mat a = _a.getMat();
-        CV_Assert(a.type() == CV_64F);
+        const int rows = a.rows;
+        forward(a, rows);
+
+        // Bin 0 and, for even rows, bin rows/2 are real; the pairs in between are contiguous
+        _b.create(rows / 2 + 1, 1, SAMPLE_TYPE);
+        Mat b = _b.getMat();
+        const Sample *X = spectrum.ptr<Sample>(0);
+        Sample *B = b.ptr<Sample>(0);
+        const int pairs = (rows - 1) / 2;
+        B[0] = std::abs(X[0]);
+        magnitudeSamples(X + 1, B + 1, pairs);
+        if (rows % 2 == 0 && rows > 1) {
+            B[rows / 2] = std::abs(X[rows - 1]);
+        }
+    }
+
+    void SpectralEngine::bandpass(InputArray _a, OutputArray _b, double low, double high, int order) {
+
+        Mat a = _a.getMat();
+        const int rows = a.rows;
+
+        if (a.total() < 3) {
+            a.copyTo(_b);
+            return;
+        }
+
+        // Transform at the optimal size
+        const int size = getOptimalDFTSize(rows);
+        forward(a, size);
+
+        // Apply the filter, bin k of the packed spectrum sits at (k + 1) / 2
+        const std::vector<Sample> &h = response(size, rows, low, high, order);
+        Sample *X = spectrum.ptr<Sample>(0);
+        for (int j = 0; j < size; j++) {
+            X[j] *= h[(j + 1) / 2];
+        }
+
+        // Back to the time domain
+        idft(spectrum, output, DFT_REAL_OUTPUT);
+
+        // Normalise the unpadded part
+        Mat result = output.colRange(0, rows);
+        normalize(result, result, 0, 1, NORM_MINMAX);
+        _b.create(rows, 1, SAMPLE_TYPE);
+        Mat b = _b.getMat();
+        for (int i = 0; i < rows; i++) {
+            b.at<Sample>(i, 0) = result.at<Sample>(0, i);
+        }
+    }
+
+    // Butterworth bandpass response for bins [0, size/2], with cutoffs in bins of the unpadded length
+    const std::vector<Sample> &SpectralEngine::response(int size, int rows, double low, double high, int order) {
+
+        ResponseKey key = {size, rows, order, low, high};
+        std::map<ResponseKey, std::vector<Sample> >::iterator it = responses.find(key);
+        if (it != responses.end()) {
+            return it->second;
+        }
+
+        // Keep the cache small, the band only changes with the window length and frame rate
+        if (responses.size() >= 16) {
+            responses.clear();
+        }
+
+        std::vector<Sample> &h = responses[key];
+        h.resize(size / 2 + 1);
+        for (int k = 0; k <= size / 2; k++) {
+            const double radius = (double)k * rows / size;
+            h[k] = 1 / (1 + pow(radius / high, 2 * order)) - 1 / (1 + pow(radius / low, 2 * order));
+        }
+        return h;
+    }
+
+    /* SOLVERS */
+
+    static void cross(const double a[3], const double b[3], double c[3]) {
+        c[0] = a[1] * b[2] - a[2] * b[1];
+        c[1] = a[2] * b[0] - a[0] * b[2];
+        c[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    static double dot(const double a[3], const double b[3]) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // Unit eigenvector of the symmetric matrix m for the eigenvalue e, as the largest cross product
+    // of two rows of m - eI. Returns false if e is not a simple eigenvalue.
+    static bool eigenvector3(const double m[3][3], double e, double v[3]) {
+        double r[3][3];
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                r[i][j] = m[i][j] - (i == j ? e : 0);
+            }
+        }
+        double c[3][3];
+        cross(r[0], r[1], c[0]);
+        cross(r[0], r[2], c[1]);
+        cross(r[1], r[2], c[2]);
+        int best = 0;
+        double norms[3];
+        for (int i = 0; i < 3; i++) {
+            norms[i] = dot(c[i], c[i]);
+            if (norms[i] > norms[best]) best = i;
+        }
+        double scale = 0;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                scale = std::max(scale, std::abs(r[i][j]));
+            }
+        }
+        if (norms[best] <= 1e-20 * scale * scale * scale * scale) {
+            return false;
+        }
+        const double inv = 1 / std::sqrt(norms[best]);
+        for (int j = 0; j < 3; j++) {
+            v[j] = c[best][j] * inv;
+        }
+        return true;
+    }
+
+    // Any unit vector orthogonal to the unit vector a
+    static void orthogonal3(const double a[3], double b[3]) {
+        const double axis[3] = {std::abs(a[0]) < 0.5 ? 1.0 : 0.0, std::abs(a[0]) < 0.5 ? 0.0 : 1.0, 0};
+        cross(a, axis, b);
+        const double inv = 1 / std::sqrt(dot(b, b));
+        for (int j = 0; j < 3; j++) {
+            b[j] *= inv;
+        }
+    }
+
+    void eigenSymmetric3(const double a[6], double values[3], double vectors[3][3]) {
+
+        const double m[3][3] = {{a[0], a[1], a[2]}, {a[1], a[3], a[4]}, {a[2], a[4], a[5]}};
+        const double off = a[1] * a[1] + a[2] * a[2] + a[4] * a[4];
+
+        // Eigenvalues from the trigonometric solution of the characteristic cubic
+        const double q = (a[0] + a[3] + a[5]) / 3;
+        const double p2 = (a[0] - q) * (a[0] - q) + (a[3] - q) * (a[3] - q) + (a[5] - q) * (a[5] - q) + 2 * off;
+        const double p = std::sqrt(p2 / 6);
+        if (p == 0) {
+            // Multiple of the identity
+            for (int i = 0; i < 3; i++) {
+                values[i] = q;
+                for (int j = 0; j < 3; j++) {
+                    vectors[i][j] = i == j ? 1 : 0;
+                }
+            }
+            return;
+        }
+        double b[3][3];
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                b[i][j] = (m[i][j] - (i == j ? q : 0)) / p;
+            }
+        }
+        const double det = b[0][0] * (b[1][1] * b[2][2] - b[1][2] * b[2][1])
+                         - b[0][1] * (b[1][0] * b[2][2] - b[1][2] * b[2][0])
+                         + b[0][2] * (b[1][0] * b[2][1] - b[1][1] * b[2][0]);
+        const double phi = std::acos(std::max(-1.0, std::min(1.0, det / 2))) / 3;
+        values[0] = q + 2 * p * std::cos(phi);
+        values[2] = q + 2 * p * std::cos(phi + 2 * CV_PI / 3);
+        values[1] = 3 * q - values[0] - values[2];
+
+        // Start with the better separated end of the spectrum, the middle vector completes the basis
+        const int first = values[0] - values[1] >= values[1] - values[2] ? 0 : 2;
+        const int last = 2 - first;
+        if (!eigenvector3(m, values[first], vectors[first])) {
+            vectors[first][0] = first == 0 ? 1 : 0;
+            vectors[first][1] = 0;
+            vectors[first][2] = first == 0 ? 0 : 1;
+        }
+        double v[3];
+        bool found = eigenvector3(m, values[last], v);
+        if (found) {
+            // Remove any component along the first vector left by rounding
+            const double d = dot(v, vectors[first]);
+            for (int j = 0; j < 3; j++) {
+                v[j] -= d * vectors[first][j];
+            }
+            const double norm = std::sqrt(dot(v, v));
+            found = norm > 1e-6;
+            for (int j = 0; j < 3 && found; j++) {
+                v[j] /= norm;
+            }
+        }
+        if (!found) {
+            orthogonal3(vectors[first], v);
+        }
+        std::copy(v, v + 3, vectors[last]);
+        cross(vectors[2], vectors[0], vectors[1]);
+    }
+
+    Mat estimateSimilarity(const std::vector<Point2f> &from, const std::vector<Point2f> &to) {
+
+        CV_Assert(from.size() == to.size());
+        const int n = (int)from.size();
+        if (n < 2) {
+            return Mat();
+        }
+
+        // Centroids
+        double fx = 0, fy = 0, tx = 0, ty = 0;
+        for (int i = 0; i < n; i++) {
+            fx += from[i].x;
+            fy += from[i].y;
+            tx += to[i].x;
+            ty += to[i].y;
+        }
+        fx /= n;
+        fy /= n;
+        tx /= n;
+        ty /= n;
+
+        // x' = a * x - b * y + c, y' = b * x + a * y + d on the centred points
+        double norm = 0, a = 0, b = 0;
+        for (int i = 0; i < n; i++) {
+            const double x = from[i].x - fx, y = from[i].y - fy;
+            const double u = to[i].x - tx, v = to[i].y - ty;
+            norm += x * x + y * y;
+            a += x * u + y * v;
+            b += x * v - y * u;
+        }
+        if (norm <= 0) {
+            return Mat();
+        }
+        a /= norm;
+        b /= norm;
+
+        Mat transform(2, 3, CV_64F);
+        transform.at<double>(0, 0) = a;
+        transform.at<double>(0, 1) = -b;
+        transform.at<double>(0, 2) = tx - a * fx + b * fy;
+        transform.at<double>(1, 0) = b;
+        transform.at<double>(1, 1) = a;
+        transform.at<double>(1, 2) = ty - b * fx - a * fy;
+        return transform;
+    }
+
+    // Bands of the rows x rows matrix I + λ^2 * D2^t*D2 for the columns [from, from + count)
+    static void smoothnessPriorsBands(int rows, int lambda, int from, int count,
+                                      vector<double> &a0, vector<double> &a1, vector<double> &a2) {
+
+        const double lambda2 = (double)lambda * lambda;
+        const double c[] = {1, -2, 1};
 
-        // Perform PCA
-        cv::PCA pca(a, cv::Mat(), CV_PCA_DATA_AS_ROW);
-
-        // Calculate PCA components
-        cv::Mat pc = a * pca.eigenvectors.t();
-
-        // Band mask
-        const int total = a.rows;
-        Mat bandMask = Mat::zeros(a.rows, 1, CV_8U);
-        bandMask.rowRange(min(low, total), min(high, total) + 1).setTo(ONE);
-
-        // Identify most distinct
-        std::vector<double> vals;
-        for (int i = 0; i < pc.cols; i++) {
-            cv::Mat magnitude = Mat(pc.rows, 1, CV_32F);
-            // Calculate spectral magnitudes
-            cv::timeToFrequency(pc.col(i), magnitude, true);
-            // Normalize
-            //printMat<float>("magnitude1", magnitude);
-            cv::normalize(magnitude, magnitude, 1, 0, NORM_L1, -1, bandMask);
-            //printMat<float>("magnitude2", magnitude);
-            // Grab index of max
-            double min, max;
-            Point pmin, pmax;
-            cv::minMaxLoc(magnitude, &min, &max, &pmin, &pmax, bandMask);
-            vals.push_back(max);
-
-        }
-
-        // Select most distinct
-        int idx[2];
-        cv::minMaxIdx(vals, 0, 0, 0, &idx[0]);
-        if (idx[0] == -1) {
-            pc.col(1).copyTo(_b);
+        a0.assign(count, 0);
+        a1.assign(count, 0);
+        a2.assign(count, 0);
+
+        for (int n = 0; n < count; n++) {
+
+            // Sum over the rows k of D2 that touch column i
+            const int i = from + n;
+            for (int k = std::max(0, i - 2); k <= std::min(i, rows - 3); k++) {
+                a0[n] += c[i-k] * c[i-k];
+                if (i - k + 1 <= 2) a1[n] += c[i-k] * c[i-k+1];
+                if (i - k + 2 <= 2) a2[n] += c[i-k] * c[i-k+2];
+            }
+            a0[n] = 1 + lambda2 * a0[n];
+            a1[n] = lambda2 * a1[n];
+            a2[n] = lambda2 * a2[n];
+        }
+    }
+
+    // LDL^t factorisation of a symmetric pentadiagonal matrix given by its bands
+    static void factoriseBanded(const vector<double> &a0, const vector<double> &a1, const vector<double> &a2,
+                                vector<double> &d, vector<double> &l1, vector<double> &l2) {
+
+        const int rows = (int)a0.size();
+
+        d.assign(rows, 0);
+        l1.assign(rows, 0);
+        l2.assign(rows, 0);
+
+        for (int i = 0; i < rows; i++) {
+
+            double di = a0[i];
+            if (i >= 1) di -= l1[i-1] * l1[i-1] * d[i-1];
+            if (i >= 2) di -= l2[i-2] * l2[i-2] * d[i-2];
+            d[i] = di;
+
+            double l1i = a1[i];
+            if (i >= 1) l1i -= l2[i-1] * l1[i-1] * d[i-1];
+            l1[i] = i + 1 < rows ? l1i / di : 0;
+            l2[i] = i + 2 < rows ? a2[i] / di : 0;
+        }
+    }
+
+    // Solve L * D * L^t * x = x in place for a rows x cols row-major block
+    static void solveBanded(const vector<double> &d, const vector<double> &l1, const vector<double> &l2,
+                            double *x, int rows, int cols) {
+
+        // Forward substitution
+        for (int i = 0; i < rows; i++) {
+            double *xi = x + i * cols;
+            for (int j = 0; j < cols; j++) {
+                if (i >= 1) xi[j] -= l1[i-1] * xi[j - cols];
+                if (i >= 2) xi[j] -= l2[i-2] * xi[j - 2 * cols];
+            }
+        }
+
+        // Back substitution
+        for (int i = rows - 1; i >= 0; i--) {
+            double *xi = x + i * cols;
+            for (int j = 0; j < cols; j++) {
+                xi[j] /= d[i];
+                if (i + 1 < rows) xi[j] -= l1[i] * xi[j + cols];
+                if (i + 2 < rows) xi[j] -= l2[i] * xi[j + 2 * cols];
+            }
+        }
+    }
+
+    // Calculate b = (I - (I + λ^2 * D2^t*D2)^-1) * a without forming the inverse
+    void DetrendFilter::apply(InputArray _a, OutputArray _b, int lambda) {
+
+        Mat a = _a.getMat();
+        CV_Assert(a.type() == SAMPLE_TYPE);
+
+        const int rows = a.rows;
+        const int cols = a.cols;
+
+        if (rows < 3) {
+            a.copyTo(_b);
+            return;
+        }
+
+        if (rows != this->rows || lambda != this->lambda) {
+            factorise(rows, lambda);
+        }
+
+        // Solve for the trend
+        x.resize(rows * cols);
+        for (int i = 0; i < rows; i++) {
+            std::copy(a.ptr<Sample>(i), a.ptr<Sample>(i) + cols, &x[i * cols]);
+        }
+        solveBanded(d, l1, l2, &x[0], rows, cols);
+
+        // Subtract the trend from the input
+        _b.create(rows, cols, SAMPLE_TYPE);
+        Mat b = _b.getMat();
+        for (int i = 0; i < rows; i++) {
+            const Sample *ai = a.ptr<Sample>(i);
+            const double *xi = &x[i * cols];
+            Sample *bi = b.ptr<Sample>(i);
+            for (int j = 0; j < cols; j++) {
+                bi[j] = ai[j] - xi[j];
+            }
+        }
+    }
+
+    void DetrendFilter::factorise(int rows, int lambda) {
+        this->rows = rows;
+        this->lambda = lambda;
+        vector<double> a0, a1, a2;
+        smoothnessPriorsBands(rows, lambda, 0, rows, a0, a1, a2);
+        factoriseBanded(a0, a1, a2, d, l1, l2);
+    }
+
+    IncrementalDetrendFilter::IncrementalDetrendFilter(double tolerance, int resyncInterval)
+    : tolerance(tolerance), resyncInterval(resyncInterval), lambda(0), border(0) {
+        reset();
+    }
+
+    void IncrementalDetrendFilter::reset() {
+        rows = 0;
+        cols = 0;
+        first = 0;
+        updates = 0;
+        input.clear();
+        trend.clear();
+    }
+
+    // Rows of (I + λ^2 * D2^t*D2)^-1 decay like ρ^|i-j| away from the diagonal, where ρ is the
+    // modulus of the stable root of 1 + λ^2 * (z - 1)^4 / z^2 = 0. Beyond border samples from
+    // the edge, a new sample moves the batch trend by less than tolerance times its innovation.
+    void IncrementalDetrendFilter::factorise(int lambda) {
+
+        this->lambda = lambda;
+
+        if (lambda <= 0) {
+            border = 2;
         } else {
-            //pc.col(1).copyTo(_b);
-            pc.col(idx[1]).copyTo(_b);
+            std::complex<double> b(2, 1.0 / lambda);
+            std::complex<double> root = (b - std::sqrt(b * b - 4.0)) / 2.0;
+            double rho = std::min(std::abs(root), 1 / std::abs(root));
+            border = std::max(2, (int)std::ceil(std::log(tolerance) / std::log(rho)));
         }
 
-        pc.copyTo(_pc);
+        // Head and tail blocks, taken from a matrix just large enough for their inner edges to be interior
+        vector<double> a0, a1, a2;
+        smoothnessPriorsBands(border + 4, lambda, 0, border, a0, a1, a2);
+        factoriseBanded(a0, a1, a2, headD, headL1, headL2);
+        smoothnessPriorsBands(2 * border + 4, lambda, 4, 2 * border, a0, a1, a2);
+        factoriseBanded(a0, a1, a2, tailD, tailL1, tailL2);
     }
-    
+
+    void IncrementalDetrendFilter::apply(InputArray _a, OutputArray _b, int lambda, int dropped) {
+
+        Mat a = _a.getMat();
+        CV_Assert(a.type() == SAMPLE_TYPE);
+
+        const int rows = a.rows;
+        const int kept = this->rows - dropped;
+        const int added = rows - kept;
+
+        if (border == 0) {
+            factorise(lambda);
+        }
+
+        bool incremental = a.cols == cols && kept > 0 && added >= 0 && added <= border
+                           && rows >= 3 * border + 4
+                           && updates < (resyncInterval > 0 ? resyncInterval : rows);
+
+        if (incremental) {
+
+            // Discard dropped samples
+            first += dropped;
+
+            // Overlapping input may only have moved by a constant per column, which leaves the
+            // detrended signal unchanged; anything else needs a full solve
+            for (int j = 0; j < cols && incremental; j++) {
+                const double offset = a.at<Sample>(0, j) - input[first * cols + j];
+                const double check = a.at<Sample>(kept - 1, j) - input[(first + kept - 1) * cols + j];
+                if (std::abs(offset - check) > 1e-9 * (1 + std::abs(offset))) {
+                    incremental = false;
+                } else if (offset != 0) {
+                    for (int i = first; i < first + kept; i++) {
+                        input[i * cols + j] += offset;
+                        trend[i * cols + j] += offset;
+                    }
+                }
+            }
+        }
+
+        if (!incremental) {
+
+            // Full solve, which also picks up a changed lambda
+            if (lambda != this->lambda) {
+                factorise(lambda);
+            }
+            full.apply(a, _b, this->lambda);
+
+            Mat b = _b.getMat();
+            this->rows = rows;
+            cols = a.cols;
+            first = 0;
+            updates = 0;
+            input.resize(rows * cols);
+            trend.resize(rows * cols);
+            for (int i = 0; i < rows; i++) {
+                for (int j = 0; j < cols; j++) {
+                    input[i * cols + j] = a.at<Sample>(i, j);
+                    trend[i * cols + j] = a.at<Sample>(i, j) - b.at<Sample>(i, j);
+                }
+            }
+            return;
+        }
+
+        // Append new samples
+        for (int i = kept; i < rows; i++) {
+            const Sample *ai = a.ptr<Sample>(i);
+            input.insert(input.end(), ai, ai + cols);
+            trend.insert(trend.end(), ai, ai + cols);
+        }
+
+        // Compact storage once the discarded prefix outgrows the window
+        if (first > rows) {
+            input.erase(input.begin(), input.begin() + first * cols);
+            trend.erase(trend.begin(), trend.begin() + first * cols);
+            first = 0;
+        }
+
+        double *x = &trend[first * cols];
+        const double lambda2 = (double)this->lambda * this->lambda;
+
+        // Re-solve the tail with the two trend values before it held fixed. The tail spans twice the border,
+        // so that those values are at least border samples before the previous end, where the new samples
+        // and the end of the window moving no longer reach.
+        const int m = rows - 2 * border;
+        for (int i = m; i < rows; i++) {
+            std::copy(a.ptr<Sample>(i), a.ptr<Sample>(i) + cols, x + i * cols);
+        }
+        for (int j = 0; j < cols; j++) {
+            x[m * cols + j] -= lambda2 * x[(m - 2) * cols + j] - 4 * lambda2 * x[(m - 1) * cols + j];
+            x[(m + 1) * cols + j] -= lambda2 * x[(m - 1) * cols + j];
+        }
+        solveBanded(tailD, tailL1, tailL2, x + m * cols, 2 * border, cols);
+
+        // Re-solve the head with the two trend values after it held fixed
+        if (dropped > 0) {
+            for (int i = 0; i < border; i++) {
+                std::copy(a.ptr<Sample>(i), a.ptr<Sample>(i) + cols, x + i * cols);
+            }
+            for (int j = 0; j < cols; j++) {
+                x[(border - 2) * cols + j] -= lambda2 * x[border * cols + j];
+                x[(border - 1) * cols + j] -= lambda2 * x[(border + 1) * cols + j] - 4 * lambda2 * x[border * cols + j];
+            }
+            solveBanded(headD, headL1, headL2, x, border, cols);
+        }
+
+        this->rows = rows;
+        updates++;
+
+        // Subtract the trend from the input
+        _b.create(rows, cols, SAMPLE_TYPE);
+        Mat b = _b.getMat();
+        for (int i = 0; i < rows; i++) {
+            const Sample *ai = a.ptr<Sample>(i);
+            Sample *bi = b.ptr<Sample>(i);
+            for (int j = 0; j < cols; j++) {
+                bi[j] = ai[j] - x[i * cols + j];
+            }
+        }
+    }
+
     /* LOGGING */
     
     void printMagnitude(String title, Mat &powerSpectrum) {
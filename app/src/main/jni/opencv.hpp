@@ -12,8 +12,12 @@
 #include <stdio.h>
 
 #include <iostream>
+#include <map>
+#include <vector>
 #include <opencv2/core/core.hpp>
 
+#include "simd.hpp"
+
 namespace cv {
     
     const Scalar BLACK    (  0,   0,   0);
@@ -26,7 +30,6 @@ namespace cv {
     
     /* COMMON FUNCTIONS */
     
-    double getFps(cv::Mat &t, const double timeBase);
     void push(cv::Mat &m);
     void plot(cv::Mat &mat);
     double weightedMeanIndex(InputArray _a, int low, int high);
@@ -38,13 +41,162 @@ namespace cv {
     void denoise(cv::InputArray _a, cv::InputArray _jumps, cv::OutputArray _b);
     void detrend(cv::InputArray _a, cv::OutputArray _b, int lambda);
     void movingAverage(cv::InputArray _a, cv::OutputArray _b, int n, int s);
+    // Without copying a single column, or allocating once scratch has grown; _b may be _a
+    void movingAverage(cv::InputArray _a, cv::OutputArray _b, int n, int s, std::vector<Sample> &scratch);
     void bandpass(cv::InputArray _a, cv::OutputArray _b, double low, double high);
     void butterworth_bandpass_filter(cv::Mat &filter, double cutin, double cutoff, int n);
     void butterworth_lowpass_filter(cv::Mat &filter, double cutoff, int n);
     void frequencyToTime(cv::InputArray _a, cv::OutputArray _b);
     void timeToFrequency(cv::InputArray _a, cv::OutputArray _b, bool magnitude);
-    void pcaComponent(cv::InputArray _a, cv::OutputArray _b, cv::OutputArray _pc, int low, int high);
-    
+
+    /* STATEFUL FILTERS */
+
+    // Denoise for a sliding window, correcting only the rows added since the last call in one pass.
+    // Unlike denoise(), the output is not re-based when a jump leaves the window, so the two can
+    // differ by a constant per column, which the later normalisation and detrending remove.
+    class DenoiseFilter {
+
+    public:
+
+        DenoiseFilter() { reset(); }
+
+        // Denoise count single-column channels into the columns of _b. The channels are the previous
+        // input without its first dropped rows plus new rows. Returns false if the whole window had to be recomputed.
+        bool apply(const cv::Mat *channels, int count, cv::InputArray _jumps, cv::OutputArray _b, int dropped);
+
+        // Forget the previous window
+        void reset();
+
+    private:
+
+        int rows;
+        int cols;
+        int first;
+        std::vector<Sample> output;
+
+        // Running offset and last input per column
+        std::vector<double> offset;
+        std::vector<double> previous;
+    };
+
+    /* SOLVERS */
+
+    // Closed-form eigendecomposition of the symmetric 3x3 matrix with upper triangle
+    // a = {a00, a01, a02, a11, a12, a22}. Eigenvalues in descending order, unit eigenvectors as rows.
+    void eigenSymmetric3(const double a[6], double values[3], double vectors[3][3]);
+
+    // Least-squares similarity transform (rotation, uniform scale, translation) mapping from onto to,
+    // as a 2x3 CV_64F matrix. Empty for fewer than two distinct points.
+    Mat estimateSimilarity(const std::vector<Point2f> &from, const std::vector<Point2f> &to);
+
+    // Smoothness priors detrending with a banded LDL^t factorisation of (I + λ^2 * D2^t*D2).
+    // The factorisation is cached until the number of rows or lambda changes.
+    class DetrendFilter {
+
+    public:
+
+        DetrendFilter() : rows(0), lambda(0) {;}
+
+        // Detrend all columns of _a in one pass
+        void apply(cv::InputArray _a, cv::OutputArray _b, int lambda);
+
+    private:
+
+        void factorise(int rows, int lambda);
+
+        int rows;
+        int lambda;
+
+        // Diagonal and the two subdiagonals of the unit lower triangular factor
+        std::vector<double> d;
+        std::vector<double> l1;
+        std::vector<double> l2;
+
+        // Scratch for the multi column solve
+        std::vector<double> x;
+    };
+
+    // Stateful detrending for a sliding window that gains samples at the tail and loses them at the head.
+    // Only the border samples at either end are re-solved per call, twice as many at the tail, with the trend
+    // just inside held fixed, so the cost is O(border) instead of O(rows). Each call can differ from DetrendFilter
+    // by about tolerance times the innovation of the new samples; a full solve every resyncInterval calls
+    // (default: once per window length) stops that error accumulating. The difference stays within errorBound(),
+    // tolerance times the range of the input window, for any lambda and up to border new samples per call;
+    // on long random walks it peaks at about a third of that. Lambda changes are applied at the next full solve.
+    // The overlap between calls may move by a constant per column (as after denoise), nothing else.
+    class IncrementalDetrendFilter {
+
+    public:
+
+        IncrementalDetrendFilter(double tolerance = 1e-4, int resyncInterval = 0);
+
+        // Detrend _a, which is the previous input without its first dropped rows plus new rows
+        void apply(cv::InputArray _a, cv::OutputArray _b, int lambda, int dropped);
+
+        // Forget the previous window
+        void reset();
+
+        // Largest difference from DetrendFilter for an input window spanning range
+        double errorBound(double range) const { return tolerance * range; }
+
+    private:
+
+        void factorise(int lambda);
+
+        double tolerance;
+        int resyncInterval;
+        int lambda;
+        int border;
+
+        // Window state
+        int rows;
+        int cols;
+        int first;
+        int updates;
+        std::vector<double> input;
+        std::vector<double> trend;
+
+        // Factorisations of the head and tail blocks
+        std::vector<double> headD, headL1, headL2;
+        std::vector<double> tailD, tailL1, tailL2;
+
+        DetrendFilter full;
+    };
+
+    // Real input DFTs at optimal sizes, with cached filter responses and reused scratch buffers.
+    // OpenCV has no reusable DFT plans, so the optimal size and the padded buffers stand in for them.
+    class SpectralEngine {
+
+    public:
+
+        // Magnitudes of the bins [0, rows/2] of the real column _a of samples
+        void magnitude(cv::InputArray _a, cv::OutputArray _b);
+
+        // Packed spectrum of the real column _a zero padded to size, valid until the next call
+        const cv::Mat &transform(cv::InputArray _a, int size);
+
+        // Butterworth bandpass of the real column _a with cutoffs in bins of its length, normalised to [0, 1]
+        void bandpass(cv::InputArray _a, cv::OutputArray _b, double low, double high, int order = 8);
+
+    private:
+
+        // Transform _a, zero padded to size, into the packed spectrum
+        void forward(const cv::Mat &a, int size);
+
+        const std::vector<Sample> &response(int size, int rows, double low, double high, int order);
+
+        struct ResponseKey {
+            int size, rows, order;
+            double low, high;
+            bool operator<(const ResponseKey &k) const;
+        };
+        std::map<ResponseKey, std::vector<Sample> > responses;
+
+        cv::Mat buffer;
+        cv::Mat spectrum;
+        cv::Mat output;
+    };
+
     /* LOGGING */
     
     void printMatInfo(const std::string &name, InputArray _a);
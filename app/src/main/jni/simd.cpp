@@ -0,0 +1,362 @@
+//
+//  simd.cpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if (defined(__ARM_NEON__) || defined(__ARM_NEON)) && defined(RPPG_SINGLE_PRECISION)
+#include <arm_neon.h>
+#define SIMD_NEON
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_AVX
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_SSE
+#endif
+
+// Integer kernels on bytes don't depend on the precision of the samples
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SIMD_BYTES_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_BYTES_SSE
+#endif
+
+namespace cv {
+
+#if defined(SIMD_NEON) || defined(SIMD_AVX) || defined(SIMD_SSE)
+
+    // Minimal vector of samples, unaligned loads and stores throughout
+    struct SampleVector {
+
+#if defined(SIMD_NEON)
+        enum { lanes = 4 };
+        typedef float32x4_t Type;
+        static Type load(const float *p) { return vld1q_f32(p); }
+        static void store(float *p, Type a) { vst1q_f32(p, a); }
+        static Type all(float x) { return vdupq_n_f32(x); }
+        static Type add(Type a, Type b) { return vaddq_f32(a, b); }
+        static Type sub(Type a, Type b) { return vsubq_f32(a, b); }
+        static Type mul(Type a, Type b) { return vmulq_f32(a, b); }
+        static Type sqrt(Type a) {
+            // Reciprocal square root estimate with two Newton steps, zero where a is zero
+            Type e = vrsqrteq_f32(a);
+            e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(a, e), e));
+            e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(a, e), e));
+            return vbslq_f32(vceqq_f32(a, vdupq_n_f32(0)), a, vmulq_f32(a, e));
+        }
+#elif defined(SIMD_AVX) && defined(RPPG_SINGLE_PRECISION)
+        enum { lanes = 8 };
+        typedef __m256 Type;
+        static Type load(const float *p) { return _mm256_loadu_ps(p); }
+        static void store(float *p, Type a) { _mm256_storeu_ps(p, a); }
+        static Type all(float x) { return _mm256_set1_ps(x); }
+        static Type add(Type a, Type b) { return _mm256_add_ps(a, b); }
+        static Type sub(Type a, Type b) { return _mm256_sub_ps(a, b); }
+        static Type mul(Type a, Type b) { return _mm256_mul_ps(a, b); }
+        static Type sqrt(Type a) { return _mm256_sqrt_ps(a); }
+#elif defined(SIMD_AVX)
+        enum { lanes = 4 };
+        typedef __m256d Type;
+        static Type load(const double *p) { return _mm256_loadu_pd(p); }
+        static void store(double *p, Type a) { _mm256_storeu_pd(p, a); }
+        static Type all(double x) { return _mm256_set1_pd(x); }
+        static Type add(Type a, Type b) { return _mm256_add_pd(a, b); }
+        static Type sub(Type a, Type b) { return _mm256_sub_pd(a, b); }
+        static Type mul(Type a, Type b) { return _mm256_mul_pd(a, b); }
+        static Type sqrt(Type a) { return _mm256_sqrt_pd(a); }
+#elif defined(RPPG_SINGLE_PRECISION)
+        enum { lanes = 4 };
+        typedef __m128 Type;
+        static Type load(const float *p) { return _mm_loadu_ps(p); }
+        static void store(float *p, Type a) { _mm_storeu_ps(p, a); }
+        static Type all(float x) { return _mm_set1_ps(x); }
+        static Type add(Type a, Type b) { return _mm_add_ps(a, b); }
+        static Type sub(Type a, Type b) { return _mm_sub_ps(a, b); }
+        static Type mul(Type a, Type b) { return _mm_mul_ps(a, b); }
+        static Type sqrt(Type a) { return _mm_sqrt_ps(a); }
+#else
+        enum { lanes = 2 };
+        typedef __m128d Type;
+        static Type load(const double *p) { return _mm_loadu_pd(p); }
+        static void store(double *p, Type a) { _mm_storeu_pd(p, a); }
+        static Type all(double x) { return _mm_set1_pd(x); }
+        static Type add(Type a, Type b) { return _mm_add_pd(a, b); }
+        static Type sub(Type a, Type b) { return _mm_sub_pd(a, b); }
+        static Type mul(Type a, Type b) { return _mm_mul_pd(a, b); }
+        static Type sqrt(Type a) { return _mm_sqrt_pd(a); }
+#endif
+    };
+
+    typedef SampleVector V;
+
+#endif
+
+    void repeatColumns(Sample *pattern, int cols) {
+        for (int j = cols; j < SAMPLE_PATTERN_ROWS * cols; j++) {
+            pattern[j] = pattern[j - cols];
+        }
+    }
+
+    void normaliseSamples(const Sample *a, Sample *b, int rows, int cols, const Sample *mean, const Sample *scale) {
+
+        const int total = rows * cols;
+        int i = 0;
+
+#if defined(SIMD_NEON) || defined(SIMD_AVX) || defined(SIMD_SSE)
+        // Blocks of lanes rows, so that every vector sees the same part of the column patterns each time
+        const int block = V::lanes * cols;
+        for (; i + block <= total; i += block) {
+            for (int j = 0; j < block; j += V::lanes) {
+                V::Type x = V::sub(V::load(a + i + j), V::load(mean + j));
+                V::store(b + i + j, V::mul(x, V::load(scale + j)));
+            }
+        }
+#endif
+
+        for (; i < total; i++) {
+            const int c = i % cols;
+            b[i] = (a[i] - mean[c]) * scale[c];
+        }
+    }
+
+    void projectSamples(const Sample *a, Sample *b, int rows, int cols, const Sample *weights) {
+
+        int i = 0;
+
+#if defined(SIMD_NEON)
+        if (cols == 3) {
+            // Deinterleaving loads
+            const float32x4_t w0 = vdupq_n_f32(weights[0]);
+            const float32x4_t w1 = vdupq_n_f32(weights[1]);
+            const float32x4_t w2 = vdupq_n_f32(weights[2]);
+            for (; i + 4 <= rows; i += 4) {
+                float32x4x3_t x = vld3q_f32(a + 3 * i);
+                float32x4_t y = vmulq_f32(x.val[0], w0);
+                y = vmlaq_f32(y, x.val[1], w1);
+                y = vmlaq_f32(y, x.val[2], w2);
+                vst1q_f32(b + i, y);
+            }
+        }
+#elif (defined(SIMD_AVX) || defined(SIMD_SSE)) && defined(RPPG_SINGLE_PRECISION)
+        if (cols == 3) {
+            // Deinterleave four rows with 128 bit shuffles, which also serve AVX
+            const __m128 w0 = _mm_set1_ps(weights[0]);
+            const __m128 w1 = _mm_set1_ps(weights[1]);
+            const __m128 w2 = _mm_set1_ps(weights[2]);
+            for (; i + 4 <= rows; i += 4) {
+                const __m128 x0 = _mm_loadu_ps(a + 3 * i);
+                const __m128 x1 = _mm_loadu_ps(a + 3 * i + 4);
+                const __m128 x2 = _mm_loadu_ps(a + 3 * i + 8);
+                const __m128 c0 = _mm_shuffle_ps(x0, _mm_shuffle_ps(x1, x2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+                const __m128 c1 = _mm_shuffle_ps(_mm_shuffle_ps(x0, x1, _MM_SHUFFLE(0, 0, 1, 1)),
+                                                 _mm_shuffle_ps(x1, x2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+                const __m128 c2 = _mm_shuffle_ps(_mm_shuffle_ps(x0, x1, _MM_SHUFFLE(1, 1, 2, 2)), x2, _MM_SHUFFLE(3, 0, 2, 0));
+                _mm_storeu_ps(b + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, w0), _mm_mul_ps(c1, w1)), _mm_mul_ps(c2, w2)));
+            }
+        }
+#elif defined(SIMD_AVX) || defined(SIMD_SSE)
+        if (cols == 3) {
+            // Deinterleave two rows with 128 bit shuffles, which also serve AVX
+            const __m128d w0 = _mm_set1_pd(weights[0]);
+            const __m128d w1 = _mm_set1_pd(weights[1]);
+            const __m128d w2 = _mm_set1_pd(weights[2]);
+            for (; i + 2 <= rows; i += 2) {
+                const __m128d x0 = _mm_loadu_pd(a + 3 * i);
+                const __m128d x1 = _mm_loadu_pd(a + 3 * i + 2);
+                const __m128d x2 = _mm_loadu_pd(a + 3 * i + 4);
+                const __m128d c0 = _mm_shuffle_pd(x0, x1, 2);
+                const __m128d c1 = _mm_shuffle_pd(x0, x2, 1);
+                const __m128d c2 = _mm_shuffle_pd(x1, x2, 2);
+                _mm_storeu_pd(b + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(c0, w0), _mm_mul_pd(c1, w1)), _mm_mul_pd(c2, w2)));
+            }
+        }
+#endif
+
+        for (; i < rows; i++) {
+            Sample y = 0;
+            for (int c = 0; c < cols; c++) {
+                y += weights[c] * a[i * cols + c];
+            }
+            b[i] = y;
+        }
+    }
+
+    void addWeightedSamples(const Sample *a, Sample wa, const Sample *b, Sample wb, Sample *c, int n) {
+
+        int i = 0;
+
+#if defined(SIMD_NEON) || defined(SIMD_AVX) || defined(SIMD_SSE)
+        const V::Type va = V::all(wa);
+        const V::Type vb = V::all(wb);
+        for (; i + V::lanes <= n; i += V::lanes) {
+            V::store(c + i, V::add(V::mul(V::load(a + i), va), V::mul(V::load(b + i), vb)));
+        }
+#endif
+
+        for (; i < n; i++) {
+            c[i] = wa * a[i] + wb * b[i];
+        }
+    }
+
+    void differenceSamples(const Sample *a, Sample *b, int n, int s, Sample scale) {
+
+        int i = 0;
+
+#if defined(SIMD_NEON) || defined(SIMD_AVX) || defined(SIMD_SSE)
+        const V::Type vs = V::all(scale);
+        for (; i + V::lanes <= n; i += V::lanes) {
+            V::store(b + i, V::mul(V::sub(V::load(a + i + s), V::load(a + i)), vs));
+        }
+#endif
+
+        for (; i < n; i++) {
+            b[i] = (a[i + s] - a[i]) * scale;
+        }
+    }
+
+    void magnitudeSamples(const Sample *a, Sample *b, int n) {
+
+        int k = 0;
+
+#if defined(SIMD_NEON)
+        for (; k + 4 <= n; k += 4) {
+            float32x4x2_t x = vld2q_f32(a + 2 * k);
+            float32x4_t m = vmlaq_f32(vmulq_f32(x.val[0], x.val[0]), x.val[1], x.val[1]);
+            vst1q_f32(b + k, V::sqrt(m));
+        }
+#elif (defined(SIMD_AVX) || defined(SIMD_SSE)) && defined(RPPG_SINGLE_PRECISION)
+        // 128 bit shuffles, which also serve AVX without crossing lanes
+        for (; k + 4 <= n; k += 4) {
+            __m128 x0 = _mm_loadu_ps(a + 2 * k);
+            __m128 x1 = _mm_loadu_ps(a + 2 * k + 4);
+            x0 = _mm_mul_ps(x0, x0);
+            x1 = _mm_mul_ps(x1, x1);
+            __m128 re = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 im = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(b + k, _mm_sqrt_ps(_mm_add_ps(re, im)));
+        }
+#elif defined(SIMD_AVX) || defined(SIMD_SSE)
+        for (; k + 2 <= n; k += 2) {
+            __m128d x0 = _mm_loadu_pd(a + 2 * k);
+            __m128d x1 = _mm_loadu_pd(a + 2 * k + 2);
+            x0 = _mm_mul_pd(x0, x0);
+            x1 = _mm_mul_pd(x1, x1);
+            __m128d re = _mm_unpacklo_pd(x0, x1);
+            __m128d im = _mm_unpackhi_pd(x0, x1);
+            _mm_storeu_pd(b + k, _mm_sqrt_pd(_mm_add_pd(re, im)));
+        }
+#endif
+
+        for (; k < n; k++) {
+            b[k] = std::sqrt(a[2 * k] * a[2 * k] + a[2 * k + 1] * a[2 * k + 1]);
+        }
+    }
+
+    /* BYTE KERNELS */
+
+    // Chroma limits on the differences 128 * R - Y and 128 * B - Y, with Y = 38 * R + 75 * G + 15 * B the luma
+    // scaled by 128. As Cr = 128 + 0.713 * (R - Y) and Cb = 128 + 0.564 * (B - Y), the gate needs no more than
+    // the luma multiplications, and everything fits into 16 bit lanes.
+    static short chromaLimit(int value, double factor, bool upper) {
+        double limit = (value - 128) * 128 / factor;
+        limit = upper ? std::floor(limit) : std::ceil(limit);
+        return (short)std::max(-32768.0, std::min(32767.0, limit));
+    }
+
+    void sumSkinPixels(const uchar *rgba, int n, const int *cr, const int *cb, unsigned int sums[4]) {
+
+        const short dLow = cr ? chromaLimit(cr[0], 0.713, false) : -32768;
+        const short dHigh = cr ? chromaLimit(cr[1], 0.713, true) : 32767;
+        const short eLow = cb ? chromaLimit(cb[0], 0.564, false) : -32768;
+        const short eHigh = cb ? chromaLimit(cb[1], 0.564, true) : 32767;
+
+        int i = 0;
+
+#if defined(SIMD_BYTES_NEON)
+        // Deinterleaving loads of 8 pixels, pairwise widening accumulation of the accepted ones
+        const int16x8_t vdLow = vdupq_n_s16(dLow), vdHigh = vdupq_n_s16(dHigh);
+        const int16x8_t veLow = vdupq_n_s16(eLow), veHigh = vdupq_n_s16(eHigh);
+        const uint16x8_t one = vdupq_n_u16(1);
+        uint32x4_t sr = vdupq_n_u32(0), sg = vdupq_n_u32(0), sb = vdupq_n_u32(0), sn = vdupq_n_u32(0);
+        for (; i + 8 <= n; i += 8) {
+            uint8x8x4_t x = vld4_u8(rgba + 4 * i);
+            uint16x8_t r = vmovl_u8(x.val[0]);
+            uint16x8_t g = vmovl_u8(x.val[1]);
+            uint16x8_t b = vmovl_u8(x.val[2]);
+            int16x8_t y = vmulq_n_s16(vreinterpretq_s16_u16(r), 38);
+            y = vmlaq_n_s16(y, vreinterpretq_s16_u16(g), 75);
+            y = vmlaq_n_s16(y, vreinterpretq_s16_u16(b), 15);
+            int16x8_t d = vsubq_s16(vreinterpretq_s16_u16(vshlq_n_u16(r, 7)), y);
+            int16x8_t e = vsubq_s16(vreinterpretq_s16_u16(vshlq_n_u16(b, 7)), y);
+            uint16x8_t m = vandq_u16(vandq_u16(vcgeq_s16(d, vdLow), vcleq_s16(d, vdHigh)),
+                                     vandq_u16(vcgeq_s16(e, veLow), vcleq_s16(e, veHigh)));
+            sr = vpadalq_u16(sr, vandq_u16(r, m));
+            sg = vpadalq_u16(sg, vandq_u16(g, m));
+            sb = vpadalq_u16(sb, vandq_u16(b, m));
+            sn = vpadalq_u16(sn, vandq_u16(one, m));
+        }
+        const uint32x4_t *lanes[4] = {&sr, &sg, &sb, &sn};
+        for (int c = 0; c < 4; c++) {
+            uint32_t t[4];
+            vst1q_u32(t, *lanes[c]);
+            sums[c] += t[0] + t[1] + t[2] + t[3];
+        }
+#elif defined(SIMD_BYTES_SSE)
+        // Two loads of 4 pixels, channels masked out of the 32 bit lanes and packed into 16 bit lanes
+        const __m128i vdLow = _mm_set1_epi16(dLow), vdHigh = _mm_set1_epi16(dHigh);
+        const __m128i veLow = _mm_set1_epi16(eLow), veHigh = _mm_set1_epi16(eHigh);
+        const __m128i lowByte = _mm_set1_epi32(0xFF);
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i wr = _mm_set1_epi16(38), wg = _mm_set1_epi16(75), wb = _mm_set1_epi16(15);
+        __m128i sr = _mm_setzero_si128(), sg = _mm_setzero_si128(), sb = _mm_setzero_si128(), sn = _mm_setzero_si128();
+        for (; i + 8 <= n; i += 8) {
+            __m128i p0 = _mm_loadu_si128((const __m128i *)(rgba + 4 * i));
+            __m128i p1 = _mm_loadu_si128((const __m128i *)(rgba + 4 * i + 16));
+            __m128i r = _mm_packs_epi32(_mm_and_si128(p0, lowByte), _mm_and_si128(p1, lowByte));
+            __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), lowByte),
+                                        _mm_and_si128(_mm_srli_epi32(p1, 8), lowByte));
+            __m128i b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), lowByte),
+                                        _mm_and_si128(_mm_srli_epi32(p1, 16), lowByte));
+            __m128i y = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, wr), _mm_mullo_epi16(g, wg)),
+                                      _mm_mullo_epi16(b, wb));
+            __m128i d = _mm_sub_epi16(_mm_slli_epi16(r, 7), y);
+            __m128i e = _mm_sub_epi16(_mm_slli_epi16(b, 7), y);
+            __m128i rejected = _mm_or_si128(_mm_or_si128(_mm_cmplt_epi16(d, vdLow), _mm_cmpgt_epi16(d, vdHigh)),
+                                            _mm_or_si128(_mm_cmplt_epi16(e, veLow), _mm_cmpgt_epi16(e, veHigh)));
+            sr = _mm_add_epi32(sr, _mm_madd_epi16(_mm_andnot_si128(rejected, r), one));
+            sg = _mm_add_epi32(sg, _mm_madd_epi16(_mm_andnot_si128(rejected, g), one));
+            sb = _mm_add_epi32(sb, _mm_madd_epi16(_mm_andnot_si128(rejected, b), one));
+            sn = _mm_add_epi32(sn, _mm_madd_epi16(_mm_andnot_si128(rejected, one), one));
+        }
+        const __m128i *lanes[4] = {&sr, &sg, &sb, &sn};
+        for (int c = 0; c < 4; c++) {
+            unsigned int t[4];
+            _mm_storeu_si128((__m128i *)t, *lanes[c]);
+            sums[c] += t[0] + t[1] + t[2] + t[3];
+        }
+#endif
+
+        for (; i < n; i++) {
+            const uchar *p = rgba + 4 * i;
+            const int y = 38 * p[0] + 75 * p[1] + 15 * p[2];
+            const int d = (p[0] << 7) - y;
+            const int e = (p[2] << 7) - y;
+            if (d >= dLow && d <= dHigh && e >= eLow && e <= eHigh) {
+                sums[0] += p[0];
+                sums[1] += p[1];
+                sums[2] += p[2];
+                sums[3]++;
+            }
+        }
+    }
+}
@@ -0,0 +1,63 @@
+//
+//  simd.hpp
+//  Heartbeat
+//
+//  Copyright © 2016 Philipp Roüast. All rights reserved.
+//
+
+#ifndef simd_hpp
+#define simd_hpp
+
+#include <opencv2/core/core.hpp>
+
+namespace cv {
+
+    // Precision of the signal path, single if built with RPPG_SINGLE_PRECISION, and by default on ARM with NEON,
+    // which only has single precision vectors on ARMv7 (RPPG_DOUBLE_PRECISION keeps double there).
+    // Solvers, statistics and spectra accumulate in double either way.
+#if (defined(__ARM_NEON__) || defined(__ARM_NEON)) && !defined(RPPG_DOUBLE_PRECISION) && !defined(RPPG_SINGLE_PRECISION)
+#define RPPG_SINGLE_PRECISION
+#endif
+#ifdef RPPG_SINGLE_PRECISION
+    typedef float Sample;
+#else
+    typedef double Sample;
+#endif
+    const int SAMPLE_TYPE = DataType<Sample>::type;
+
+    /* KERNELS */
+
+    // Vectorised with AVX or SSE2 on x86 and with NEON on ARM, which only has single precision vectors
+    // on ARMv7. Other targets and the remainders get the scalar loop. Outputs may alias inputs.
+
+    // Rows of a column pattern, enough for the widest vector
+    const int SAMPLE_PATTERN_ROWS = 8;
+
+    // Repeat the first cols values of pattern for SAMPLE_PATTERN_ROWS rows
+    void repeatColumns(Sample *pattern, int cols);
+
+    // b = (a - mean) * scale on rows x cols interleaved samples. Mean and scale are column patterns, per column
+    // values repeated by repeatColumns, which the caller keeps so that the kernel doesn't build them every call.
+    void normaliseSamples(const Sample *a, Sample *b, int rows, int cols, const Sample *mean, const Sample *scale);
+
+    // b = sum of weights[c] * a[c] for each row of rows x cols interleaved samples
+    void projectSamples(const Sample *a, Sample *b, int rows, int cols, const Sample *weights);
+
+    // c = wa * a + wb * b
+    void addWeightedSamples(const Sample *a, Sample wa, const Sample *b, Sample wb, Sample *c, int n);
+
+    // b[i] = (a[i + s] - a[i]) * scale, which is a box filter of width s on running sums a
+    void differenceSamples(const Sample *a, Sample *b, int n, int s, Sample scale);
+
+    // b[k] = |a[2k] + i * a[2k + 1]|
+    void magnitudeSamples(const Sample *a, Sample *b, int n);
+
+    /* BYTE KERNELS */
+
+    // Adds the R, G and B bytes of the n RGBA pixels at rgba whose chroma is within the inclusive 8 bit YCrCb
+    // ranges cr and cb to sums[0..2], and their count to sums[3]. A NULL range accepts every value.
+    // Each pixel is read once, without an intermediate mask.
+    void sumSkinPixels(const uchar *rgba, int n, const int *cr, const int *cb, unsigned int sums[4]);
+}
+
+#endif /* simd_hpp */